@@ -0,0 +1,103 @@
+--
+-- bench.sql - textsearch_ko 성능 측정
+--
+-- 사용법: make USE_PGXS=1 bench [BENCH_DB=dbname] [BENCH_LOOPS=n]
+--    또는 psql -X -d dbname -v loops=3 -f bench/bench.sql < bench/corpus.tsv
+--
+-- corpus.tsv 의 문서 (종류 <tab> 본문) 와 그것들을 이어 붙인 큰 문서를
+-- 종류별로 to_tsvector('korean', ...) 해서 MB/s, docs/s 를 보여주고,
+-- 단계별 시간을 나눠서 보여줌. 시간은 loops 번 돌려서 가장 짧은 것.
+--
+--  normalize : korean_normalize()
+--  mecab     : 캐시 없이 ts_parse - 캐시 적중으로 ts_parse (mecab 분석)
+--  gettoken  : 캐시 적중으로 ts_parse - normalize (파서 토큰 나누기)
+--  lexize    : 캐시 적중으로 to_tsvector - ts_parse (korean_stem, english_stem)
+--
+\set ON_ERROR_STOP on
+\if :{?loops}
+\else
+\set loops 3
+\endif
+
+CREATE EXTENSION IF NOT EXISTS textsearch_ko;
+
+CREATE TEMP TABLE bench_doc (kind text, body text);
+\copy bench_doc from pstdin
+
+-- 큰 문서: 전체 말뭉치를 이어서 1MB 넘게
+INSERT INTO bench_doc
+    SELECT 'long', string_agg(d.body, E'\n' ORDER BY r, d.kind, d.body)
+    FROM generate_series(1, 4) g, generate_series(1, 200) r, bench_doc d
+    GROUP BY g;
+
+CREATE TEMP TABLE bench_result (
+    kind        text,
+    docs        int8,
+    bytes       int8,
+    total       float8,
+    normalize   float8,
+    parse_cold  float8,
+    parse_warm  float8,
+    vector_warm float8
+);
+
+CREATE FUNCTION pg_temp.bench_time(query text, kind text, loops int)
+    RETURNS float8
+    LANGUAGE plpgsql
+AS $$
+DECLARE
+    best    float8;
+    started timestamptz;
+BEGIN
+    FOR i IN 1..loops LOOP
+        started := clock_timestamp();
+        EXECUTE query USING kind;
+        best := least(best, extract(epoch FROM clock_timestamp() - started));
+    END LOOP;
+    RETURN best;
+END
+$$;
+
+-- 캐시 없이: 문서마다 mecab 분석
+SET textsearch_ko.cache_size = 0;
+
+INSERT INTO bench_result (kind, docs, bytes, total, normalize, parse_cold)
+    SELECT kind, count(*), sum(octet_length(body)),
+        pg_temp.bench_time(
+            'SELECT sum(length(to_tsvector(''korean'', body))) FROM bench_doc WHERE kind = $1',
+            kind, :loops),
+        pg_temp.bench_time(
+            'SELECT sum(length(korean_normalize(body))) FROM bench_doc WHERE kind = $1',
+            kind, :loops),
+        pg_temp.bench_time(
+            'SELECT count(*) FROM bench_doc, ts_parse(''korean'', body) WHERE kind = $1',
+            kind, :loops)
+    FROM bench_doc
+    GROUP BY kind;
+
+-- 캐시 적중: mecab 분석 없이 파서, 사전만
+SET textsearch_ko.cache_size = '1GB';
+SELECT count(*) AS warmup FROM bench_doc, ts_parse('korean', body) \g /dev/null
+
+UPDATE bench_result SET
+    parse_warm = pg_temp.bench_time(
+        'SELECT count(*) FROM bench_doc, ts_parse(''korean'', body) WHERE kind = $1',
+        kind, :loops),
+    vector_warm = pg_temp.bench_time(
+        'SELECT sum(length(to_tsvector(''korean'', body))) FROM bench_doc WHERE kind = $1',
+        kind, :loops);
+
+RESET textsearch_ko.cache_size;
+
+SELECT kind,
+    docs,
+    round(bytes / 1048576.0, 2) AS mb,
+    round(total::numeric, 3) AS seconds,
+    round((bytes / 1048576.0 / total)::numeric, 2) AS "MB/s",
+    round((docs / total)::numeric, 1) AS "docs/s",
+    round(normalize::numeric, 3) AS normalize,
+    round(greatest(parse_cold - parse_warm, 0)::numeric, 3) AS mecab,
+    round(greatest(parse_warm - normalize, 0)::numeric, 3) AS gettoken,
+    round(greatest(vector_warm - parse_warm, 0)::numeric, 3) AS lexize
+FROM bench_result
+ORDER BY kind;
@@ -0,0 +1,123 @@
+#!/usr/bin/perl
+#
+# hanja_table.pl - 한자 -> 한글 독음 표 (hanja_table.h) 만들기
+#
+# 펄 기본 모듈인 Unicode::Collate 의 한국어 정렬 자료 (CLDR) 에서
+# 한자마다 정렬 기준 독음을 가져옴. 이 소리가 흔히 읽는 소리가 아니면 %override 로 고침.
+#  - Unicode::Collate::CJK::Korean : CJK 통합 한자 U+4E00 ~ U+9FA5
+#  - Unicode::Collate::Locale ko    : CJK 호환 한자 U+F900 ~ U+FAFF
+# 두음법칙은 적용하지 않은 본디 소리로 적고, 적용은 ts_mecab_ko.c 에서 함.
+#
+# 사용법: perl hanja_table.pl > hanja_table.h
+#
+use strict;
+use warnings;
+
+use Unicode::Collate::CJK::Korean;
+use Unicode::Collate::Locale;
+
+use constant {
+	URO_FIRST => 0x4E00,
+	URO_LAST => 0x9FA5,
+	COMPAT_FIRST => 0xF900,
+	COMPAT_LAST => 0xFAFF,
+};
+
+# 자주 쓰는 소리와 다르게 들어있는 것들
+# 不 은 ㄷ, ㅈ 앞에서 부 (부동산, 부정) 이고 이것은 ts_mecab_ko.c 에서 함
+my %override = (
+	0x91D1 => 0xAE08,	# 金 김 -> 금
+	0x7387 => 0xB960,	# 率 솔 -> 률
+	0x5B85 => 0xD0DD,	# 宅 댁 -> 택
+	0x4E0D => 0xBD88,	# 不 부 -> 불
+	0xF967 => 0xBD88,	# 不 (호환) 부 -> 불
+	0x9F9C => 0xADC0,	# 龜 구 -> 귀
+	0x6CCC => 0xBE44,	# 泌 필 -> 비
+);
+
+# 자모 정렬 가중치 -> 자모 코드 (Korean.pm 의 %jamo2prim 뒤집기)
+my $pm = $INC{'Unicode/Collate/CJK/Korean.pm'};
+open(my $fh, '<', $pm) or die "could not open $pm: $!";
+my $src = do { local $/; <$fh> };
+close($fh);
+
+my %prim2jamo;
+$prim2jamo{hex($2)} = hex($1) while $src =~ /'([0-9A-F]{4})', 0x([0-9A-F]{4})/g;
+
+sub syllable
+{
+	my ($cho, $jung, $jong) = @_;
+
+	return 0xAC00 + (($cho - 0x1100) * 21 + ($jung - 0x1161)) * 28 +
+		(defined $jong ? $jong - 0x11A7 : 0);
+}
+
+# 통합 한자: 음절 줄 다음에 그 소리를 갖는 한자들
+my %reading;
+my $data = (split(/^__DATA__\n/m, $src))[1];
+my $cur;
+foreach my $line (split(/\n/, $data))
+{
+	last if $line =~ /^__END__/;
+	if ($line =~ /^[0-9A-F]{4}:([0-9A-F-]+)$/)
+	{
+		$cur = syllable(map { hex } split(/-/, $1));
+		next;
+	}
+	foreach my $c (split(' ', $line))
+	{
+		$reading{hex($c)} //= $cur;
+	}
+}
+
+# 호환 한자: 정렬 가중치의 첫 값들이 자모
+my ($kopl) = grep { -f } map { "$_/Unicode/Collate/Locale/ko.pl" } @INC;
+die "could not find Unicode::Collate::Locale ko data" unless $kopl;
+my $ko = do $kopl or die "could not load $kopl: $@";
+foreach my $line (split(/\n/, $ko->{entry}))
+{
+	next unless $line =~ /^([0-9A-F]{4})\s*;\s*((?:\[[^\]]*\])+)/;
+	my $u = hex($1);
+	next if $u < COMPAT_FIRST || $u > COMPAT_LAST;
+
+	my @jamo = map { $prim2jamo{hex($_)} } $2 =~ /\[\.([0-9A-F]+)\./g;
+	die sprintf("unknown jamo weight for U+%04X", $u) if grep { !defined } @jamo;
+	$reading{$u} //= syllable(@jamo);
+}
+
+$reading{$_} = $override{$_} foreach keys %override;
+
+sub print_table
+{
+	my ($name, $first, $last) = @_;
+	my $n = 0;
+
+	print "static const uint16 ${name}[] = {\n";
+	for (my $u = $first; $u <= $last; $u++)
+	{
+		print "\t" if $n % 8 == 0;
+		printf("0x%04X,", $reading{$u} // 0);
+		print(($n % 8 == 7 || $u == $last) ? "\n" : " ");
+		$n++;
+	}
+	print "};\n";
+}
+
+print <<EOF;
+/*
+ * hanja_table.h
+ * 한자 -> 한글 독음 표, 없는 것은 0
+ * hanja_table.pl 로 만든 파일이므로 직접 고치지 말 것
+ */
+#ifndef HANJA_TABLE_H
+#define HANJA_TABLE_H
+
+EOF
+printf("#define HANJA_URO_FIRST\t\t0x%04X\n", URO_FIRST);
+printf("#define HANJA_URO_LAST\t\t0x%04X\n", URO_LAST);
+printf("#define HANJA_COMPAT_FIRST\t0x%04X\n", COMPAT_FIRST);
+printf("#define HANJA_COMPAT_LAST\t0x%04X\n\n", COMPAT_LAST);
+print_table('hanja_uro', URO_FIRST, URO_LAST);
+print "\n";
+print_table('hanja_compat', COMPAT_FIRST, COMPAT_LAST);
+print "\n#endif\t\t\t\t\t\t\t/* HANJA_TABLE_H */\n";
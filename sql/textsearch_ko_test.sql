@@ -0,0 +1,248 @@
+--
+-- textsearch_ko 회귀 시험
+--
+CREATE EXTENSION textsearch_ko;
+SET default_text_search_config = korean;
+-- 시험 중 캐시 적중 여부로 결과가 달라지지 않게 함
+SET textsearch_ko.cache_size = 0;
+--
+-- korean_normalize : 전각 -> 반각, 원문자, 한글과 영숫자 사이 공백
+--
+SELECT korean_normalize('ＡＢＣ１２３ 한글');
+SELECT korean_normalize('한글abc한글123');
+SELECT korean_normalize('①번, ⑩번, ⑳번');
+SELECT korean_normalize('⓵번, ⓾번, ⓫번');
+SELECT korean_normalize('PostgreSQL에서 검색하기');
+SELECT korean_normalize('Ｗｉｎｄｏｗｓ１０에서도');
+SELECT korean_normalize('');
+SET textsearch_ko.hanja_to_hangul = on;
+SELECT korean_normalize('歷史와 文化');
+RESET textsearch_ko.hanja_to_hangul;
+SELECT korean_normalize('歷史와 文化');
+--
+-- hanja2hangul : 독음 표, 두음법칙, 렬/률, 不
+--
+SELECT hanja2hangul('大韓民國 歷史');
+SELECT hanja2hangul('女子 勞動 來日');
+SELECT hanja2hangul('比率 確率 羅列 陳列');
+SELECT hanja2hangul('金曜日');
+SELECT hanja2hangul('不法 不可 不動産 不正');
+SELECT hanja2hangul('音樂 度數 說明 龜鑑 分泌');
+SELECT hanja2hangul('漢字abc漢字');
+SELECT hanja2hangul('한글과 漢字');
+-- 조각 끝의 不 은 다음 조각의 글자로 독음을 정함
+SET textsearch_ko.chunk_size = '1kB';
+SELECT right(hanja2hangul(repeat('가', 340) || 'a不動産'), 4) AS edge;
+RESET textsearch_ko.chunk_size;
+--
+-- mecabko_analyze, mecabko_tokens
+--
+SELECT count(*) > 1 AS split, bool_and(type <> '') AS tagged
+    FROM mecabko_analyze('무궁화꽃이 피었습니다.');
+SELECT string_agg(surface, '' ORDER BY byte_start) AS surfaces,
+       bool_and(substring(convert_to('무궁화꽃이 피었습니다.', 'UTF8')
+                          FROM byte_start + 1 FOR byte_end - byte_start)
+                = convert_to(surface, 'UTF8')) AS offsets
+    FROM mecabko_tokens('무궁화꽃이 피었습니다.');
+SELECT count(*) FROM mecabko_tokens('');
+--
+-- korean_stem 사전
+--
+SELECT ts_lexize('korean_stem', '무궁화');
+SELECT ts_lexize('korean_stem', '꽃');
+--
+-- 파서와 설정
+--
+SELECT to_tsvector('무궁화꽃이 피었습니다.') AS vec1,
+       to_tsvector('그래서, 무궁화꽃이 피겠는걸요?') AS vec2 \gset
+SELECT :'vec1'::tsvector @@ to_tsquery('무궁화 & 꽃') AS vec1,
+       :'vec2'::tsvector @@ to_tsquery('무궁화 & 꽃') AS vec2;
+SELECT to_tsvector('PostgreSQL Korean search');
+SELECT to_tsvector('');
+SET textsearch_ko.tokenizer = prsd;
+SELECT to_tsvector('무궁화꽃이 피었습니다.') = :'vec1'::tsvector AS vec1,
+       to_tsvector('그래서, 무궁화꽃이 피겠는걸요?') = :'vec2'::tsvector AS vec2;
+RESET textsearch_ko.tokenizer;
+--
+-- 큰 문서 : 조각 분석, 스레드 분석 결과가 한번에 분석한 것과 같아야 함
+--
+CREATE TEMP TABLE big_doc AS
+    SELECT repeat('무궁화꽃이 피었습니다. 그래서, 무궁화꽃이 피겠는걸요? ', 2000) AS body;
+SET textsearch_ko.chunk_size = 0;
+CREATE TEMP TABLE big_vec AS SELECT to_tsvector(body) AS vec FROM big_doc;
+CREATE TEMP TABLE big_tok AS
+    SELECT string_agg(concat_ws('/', surface, pos, basic, byte_start, byte_end),
+                      ' ' ORDER BY byte_start) AS toks
+    FROM big_doc, mecabko_tokens(body);
+SELECT length(vec) > 0 AS nonempty FROM big_vec;
+SET textsearch_ko.chunk_size = 16;
+SELECT to_tsvector(body) = vec FROM big_doc, big_vec;
+SELECT string_agg(concat_ws('/', surface, pos, basic, byte_start, byte_end),
+                  ' ' ORDER BY byte_start) = toks
+    FROM big_doc, mecabko_tokens(body), big_tok
+    GROUP BY toks;
+RESET textsearch_ko.chunk_size;
+SET textsearch_ko.analysis_threads = 4;
+SET textsearch_ko.parallel_threshold = 16;
+SELECT to_tsvector(body) = vec FROM big_doc, big_vec;
+RESET textsearch_ko.analysis_threads;
+RESET textsearch_ko.parallel_threshold;
+--
+-- 분석 통계
+--
+SELECT textsearch_ko_stats_reset();
+SELECT documents, tokens, lexemes, stats_reset IS NOT NULL AS reset
+    FROM textsearch_ko_stats();
+SELECT to_tsvector('무궁화꽃이 피었습니다.') @@ '꽃'::tsquery AS match;
+SELECT documents, input_bytes, tokens > 0 AS tokens, lexemes > 0 AS lexemes
+    FROM textsearch_ko_stats();
+--
+-- 헤드라인
+--
+SELECT ts_headline('무궁화꽃이 피었습니다. 그래서, 무궁화꽃이 피겠는걸요?', to_tsquery('꽃'));
+SELECT korean_headline(repeat('무궁화꽃이 피었습니다. ', 3) || 'PostgreSQL 검색',
+                       to_tsquery('postgresql'), 'MaxWords=3, MinWords=1');
+-- 헤드라인 조각이 첫 8kB 조각을 넘어 이어짐
+SELECT korean_headline(repeat('가나다 ', 817) || 'abc 무궁화꽃이 PostgreSQL 검색',
+                       to_tsquery('abc'));
+SET textsearch_ko.hanja_to_hangul = on;
+SELECT ts_headline('ＡＢＣ 大韓民國 歷史', to_tsquery('역사'));
+RESET textsearch_ko.hanja_to_hangul;
+--
+-- 검색 제외어, 낱말 길이
+--
+CREATE TEXT SEARCH DICTIONARY korean_stem_stop (
+    TEMPLATE = mecabko, stopwords = 'korean', min_length = 2);
+SELECT ts_lexize('korean_stem', '것') AS stem, ts_lexize('korean_stem_stop', '것') AS stop;
+SELECT ts_lexize('korean_stem_stop', '꽃') AS short, ts_lexize('korean_stem_stop', '무궁화') AS noun;
+CREATE TEXT SEARCH DICTIONARY korean_stem_bad (
+    TEMPLATE = mecabko, min_length = 3, max_length = 2);
+DROP TEXT SEARCH DICTIONARY korean_stem_stop;
+--
+-- 복합명사 나누기
+--
+CREATE TEXT SEARCH DICTIONARY korean_stem_parts (TEMPLATE = mecabko, compound = 'parts');
+CREATE TEXT SEARCH DICTIONARY korean_stem_both (TEMPLATE = mecabko, compound = 'both');
+SELECT ts_lexize('korean_stem', '무궁화') AS whole,
+       ts_lexize('korean_stem_parts', '무궁화') AS parts,
+       ts_lexize('korean_stem_both', '무궁화') AS both;
+CREATE TEXT SEARCH DICTIONARY korean_stem_bad (TEMPLATE = mecabko, compound = 'all');
+-- 기본 파서로 넘어온 어절은 형태소마다 복합명사나 구성 명사 중 하나만 있으면 됨
+CREATE TEXT SEARCH CONFIGURATION korean_prsd_both (PARSER = default);
+ALTER TEXT SEARCH CONFIGURATION korean_prsd_both ADD MAPPING FOR word WITH korean_stem_both;
+SELECT to_tsvector('simple', '무궁 화 꽃') @@ to_tsquery('korean_prsd_both', '무궁화꽃이') AS parts,
+       to_tsvector('simple', '무궁화 꽃') @@ to_tsquery('korean_prsd_both', '무궁화꽃이') AS whole,
+       to_tsvector('simple', '무궁화') @@ to_tsquery('korean_prsd_both', '무궁화꽃이') AS partial;
+DROP TEXT SEARCH CONFIGURATION korean_prsd_both;
+DROP TEXT SEARCH DICTIONARY korean_stem_parts;
+DROP TEXT SEARCH DICTIONARY korean_stem_both;
+--
+-- 자동 완성
+--
+CREATE TEXT SEARCH DICTIONARY korean_stem_ac (
+    TEMPLATE = mecabko, choseong = true, jamo_prefix = true);
+SELECT ts_lexize('korean_stem_ac', '무궁화');
+SELECT korean_autocomplete_query('무구 ㅁㄱ');
+SELECT q, array_to_tsvector(ts_lexize('korean_stem_ac', '무궁화')) @@ korean_autocomplete_query(q) AS match
+    FROM unnest(ARRAY['묵', '무궁호', 'ㅁㄱ', 'ㅁㅎ', '나']) AS q;
+-- 자동 완성 낱말은 일반 검색어를 좁히지 않음
+CREATE TEXT SEARCH CONFIGURATION korean_ac (COPY = korean);
+ALTER TEXT SEARCH CONFIGURATION korean_ac
+    ALTER MAPPING FOR word, hword_part, hword WITH korean_stem_ac;
+SELECT to_tsvector('korean', '무궁화꽃이 피었습니다') @@ to_tsquery('korean_ac', '무궁화') AS plain_doc,
+       to_tsvector('korean_ac', '무궁화꽃이 피었습니다') @@ to_tsquery('korean_ac', '무궁화') AS ac_doc,
+       to_tsvector('korean_ac', '무궁화꽃이 피었습니다') @@ korean_autocomplete_query('ㅁㄱ') AS autocomplete;
+DROP TEXT SEARCH CONFIGURATION korean_ac;
+DROP TEXT SEARCH DICTIONARY korean_stem_ac;
+--
+-- 동의어 사전
+--
+CREATE TEXT SEARCH DICTIONARY korean_stem_syn (
+    TEMPLATE = mecabko, synonyms = 'korean_synonym');
+SELECT ts_lexize('korean_stem_syn', '무궁화') AS synonym, ts_lexize('korean_stem_syn', '꽃') AS other;
+CREATE TEXT SEARCH DICTIONARY korean_stem_bad (
+    TEMPLATE = mecabko, synonyms = 'korean_synonym', synonyms = 'korean_synonym');
+DROP TEXT SEARCH DICTIONARY korean_stem_syn;
+--
+-- 사전 다시 읽기
+--
+SELECT textsearch_ko_reload_dictionary() > 0 AS reloaded;
+SELECT to_tsvector('무궁화꽃이 피었습니다.') @@ '무궁화 & 꽃'::tsquery AS match;
+--
+-- 분석 예산, 넘으면 나머지 어절은 mecab 없이 통째로
+--
+SET textsearch_ko.chunk_size = '1kB';
+SET textsearch_ko.analysis_size_budget = '1kB';
+SELECT textsearch_ko_stats_reset();
+SELECT to_tsvector(repeat('가 ', 256) || '학교에서') @@ '학교에서'::tsquery AS whole_eojeol;
+SELECT over_budget FROM textsearch_ko_stats();
+RESET textsearch_ko.analysis_size_budget;
+SELECT to_tsvector(repeat('가 ', 256) || '학교에서') @@ '학교에서'::tsquery AS whole_eojeol;
+RESET textsearch_ko.chunk_size;
+--
+-- 문서 배열 한번에
+--
+SELECT array_length(v, 1) AS n, v[1] = to_tsvector('무궁화꽃이 피었습니다.') AS first,
+       v[2] IS NULL AS null_kept, v[3] = to_tsvector('학교에서') AS last
+    FROM korean_to_tsvector(ARRAY['무궁화꽃이 피었습니다.', NULL, '학교에서']) AS v;
+--
+-- 병렬 작업자에서 분석
+--
+SELECT p.proname, p.proparallel
+    FROM pg_proc p
+    JOIN pg_depend d ON d.classid = 'pg_proc'::regclass AND d.objid = p.oid
+    JOIN pg_extension e ON d.refclassid = 'pg_extension'::regclass AND d.refobjid = e.oid
+    WHERE e.extname = 'textsearch_ko' AND d.deptype = 'e' AND p.proparallel <> 's'
+    ORDER BY 1;
+CREATE TABLE ko_docs (id int, body text);
+INSERT INTO ko_docs
+    SELECT i, CASE WHEN i % 2 = 0 THEN '무궁화꽃이 피었습니다.' ELSE '하늘을 나는 새' END
+    FROM generate_series(1, 2000) AS i;
+ANALYZE ko_docs;
+SET parallel_setup_cost = 0;
+SET parallel_tuple_cost = 0;
+SET min_parallel_table_scan_size = 0;
+SET max_parallel_workers_per_gather = 2;
+SELECT count(*) FROM ko_docs WHERE to_tsvector(korean_normalize(body)) @@ '꽃'::tsquery;
+SET max_parallel_maintenance_workers = 2;
+CREATE INDEX ko_docs_tsv ON ko_docs USING gin (to_tsvector('korean', body));
+SET enable_seqscan = off;
+SELECT count(*) FROM ko_docs WHERE to_tsvector('korean', body) @@ '새'::tsquery;
+RESET enable_seqscan;
+RESET max_parallel_maintenance_workers;
+RESET max_parallel_workers_per_gather;
+RESET min_parallel_table_scan_size;
+RESET parallel_tuple_cost;
+RESET parallel_setup_cost;
+DROP TABLE ko_docs;
+--
+-- 원문이 그대로면 다시 분석하지 않는 트리거
+--
+CREATE TABLE ko_posts (id int, title text, body text, views int DEFAULT 0,
+                       tsv tsvector, tsv_hash int8);
+CREATE TRIGGER ko_posts_tsv BEFORE INSERT OR UPDATE ON ko_posts
+    FOR EACH ROW EXECUTE PROCEDURE
+    korean_tsvector_update_trigger(tsv, tsv_hash, 'korean', 'title:A', body);
+INSERT INTO ko_posts (id, title, body) VALUES (1, '무궁화', '꽃이 피었습니다.');
+SELECT tsv = setweight(to_tsvector('korean', title), 'A') || to_tsvector('korean', body) AS same,
+       tsv @@ plainto_tsquery('korean', '무궁화 꽃') AS match, tsv_hash IS NOT NULL AS hashed FROM ko_posts;
+SELECT textsearch_ko_stats_reset();
+UPDATE ko_posts SET views = views + 1;
+SELECT documents FROM textsearch_ko_stats();
+UPDATE ko_posts SET body = '학교 도서관';
+SELECT documents FROM textsearch_ko_stats();
+SELECT tsv = setweight(to_tsvector('korean', title), 'A') || to_tsvector('korean', body) AS same,
+       tsv @@ plainto_tsquery('korean', '학교 도서관') AS match,
+       tsv @@ plainto_tsquery('korean', '꽃') AS stale FROM ko_posts;
+-- 해시를 맞춰 두었어도 tsvector 를 지우면 다시 분석함
+SELECT textsearch_ko_stats_reset();
+UPDATE ko_posts SET tsv = NULL;
+SELECT documents, (SELECT tsv IS NOT NULL FROM ko_posts) AS filled FROM textsearch_ko_stats();
+DROP TABLE ko_posts;
+--
+-- mecab 없이 두 글자씩 나누는 설정
+--
+SELECT to_tsvector('korean_bigram', '무궁화꽃이 피었습니다 abc');
+SELECT korean_bigram_query('korean_bigram', '무궁화 꽃');
+SELECT q, to_tsvector('korean_bigram', '무궁화꽃이 피었습니다') @@ korean_bigram_query('korean_bigram', q) AS match
+    FROM unnest(ARRAY['무궁화 꽃', '궁화', '꽃', '나무']) AS q;
@@ -0,0 +1,164 @@
+#!/usr/bin/perl
+#
+# synonym_trie.pl - 동의어 사전 (.tsv) 을 korean_stem 사전 옵션 synonyms 가 읽는
+# 더블 어레이 트라이 파일 (.trie) 로 만들기
+#
+# 한 줄에 낱말 하나: 낱말<TAB>바꿀 낱말들 (공백으로 나눔)
+# 낱말은 korean_stem 이 내는 기본형으로 적고, 원래 낱말도 색인하려면 바꿀 낱말에 같이 적음.
+# # 으로 시작하는 줄과 빈 줄은 건너뜀.
+#
+# 파일 형식 (숫자는 모두 little endian)
+#  - 머리 24바이트 : "KOTRIE1\0", 칸 수, 낱말 수, 목록 크기, 0 (uint32)
+#  - 칸들 : base (int32), check (uint32). 칸 1 이 뿌리, check 는 부모 칸 (0 이면 빈칸).
+#    바이트 b 로 가는 자식은 base + b + 1 칸, 낱말 끝은 base + 0 칸이고
+#    낱말 끝 칸의 base 는 -(목록 위치 + 1)
+#  - 목록 : 낱말마다 바꿀 낱말들을 NUL 로 끝내 잇고 빈 문자열로 끝냄
+#
+# 사용법: perl synonym_trie.pl brands.tsv > brands.trie
+#         brands.trie 를 $SHAREDIR/tsearch_data 에 두고 synonyms = 'brands'
+#
+use strict;
+use warnings;
+
+use constant MAGIC => "KOTRIE1";
+
+# 읽기, 낱말은 바이트 문자열 그대로
+my %entries;
+while (my $line = <>)
+{
+	$line =~ s/\r?\n$//;
+	next if $line =~ /^\s*(#|$)/;
+
+	my ($key, $rest) = split(/\t/, $line, 2);
+	die "$ARGV:$.: missing tab\n" unless defined $rest;
+	$key =~ s/^\s+|\s+$//g;
+	my @words = split(' ', $rest);
+	die "$ARGV:$.: empty word\n" if $key eq '' || !@words;
+	die "$ARGV:$.: duplicate word \"$key\"\n" if exists $entries{$key};
+	$entries{$key} = \@words;
+}
+continue
+{
+	close(ARGV) if eof;			# 파일마다 줄 번호 다시 셈
+}
+
+my @keys = sort keys %entries;
+
+# 바꿀 낱말 목록
+my $values = '';
+my @offset;
+foreach my $key (@keys)
+{
+	push(@offset, length($values));
+	$values .= join('', map { "$_\0" } @{ $entries{$key} }) . "\0";
+}
+$values .= "\0" while length($values) < 2;
+
+# 더블 어레이
+# 빈칸들은 위치 순서로 이은 목록으로 두고, 자식 부호가 모두 빈칸에 들어가는 첫 base 를 찾음.
+# 끝에서 WINDOW 칸보다 앞의 빈칸은 목록에서 빼서 (버려서) 찾는 시간을 일정하게 함
+use constant WINDOW => 4096;
+
+my (@base, @check);
+my (@next_free, @prev_free);
+my ($free_head, $free_tail) = (-1, -1);
+my $size = 2;				# 0 은 안 쓰고 1 은 뿌리
+
+sub free_remove
+{
+	my ($p) = @_;
+	my ($prev, $next) = ($prev_free[$p], $next_free[$p]);
+
+	if ($prev == -1) { $free_head = $next; } else { $next_free[$prev] = $next; }
+	if ($next == -1) { $free_tail = $prev; } else { $prev_free[$next] = $prev; }
+}
+
+sub extend
+{
+	my ($to) = @_;
+
+	for (; $size <= $to; $size++)
+	{
+		$prev_free[$size] = $free_tail;
+		$next_free[$size] = -1;
+		if ($free_tail == -1) { $free_head = $size; } else { $next_free[$free_tail] = $size; }
+		$free_tail = $size;
+	}
+}
+
+sub find_base
+{
+	my @codes = @_;
+
+	CANDIDATE:
+	for (my $f = $free_head; $f != -1; $f = $next_free[$f])
+	{
+		my $b = $f - $codes[0];
+
+		next if $b < 2;
+		foreach my $c (@codes[1 .. $#codes])
+		{
+			next CANDIDATE if $b + $c < $size && $check[$b + $c];
+		}
+		return $b;
+	}
+
+	# 끝 뒤는 모두 빈칸
+	my $b = $size - $codes[0];
+	return $b < 2 ? 2 : $b;
+}
+
+my @queue = ([1, 0, 0, scalar @keys]);	# 칸, 깊이, 낱말 범위
+while (my $node = shift(@queue))
+{
+	my ($s, $depth, $lo, $hi) = @$node;
+	my (@codes, @ranges);
+
+	# 정렬돼 있으므로 같은 부호 낱말들은 이어져 있고, 낱말 끝 (0) 이 먼저
+	for (my $i = $lo; $i < $hi; )
+	{
+		my $c = $depth < length($keys[$i]) ? ord(substr($keys[$i], $depth, 1)) + 1 : 0;
+		my $j = $i + 1;
+
+		$j++ while $j < $hi && ($depth < length($keys[$j]) ?
+								ord(substr($keys[$j], $depth, 1)) + 1 : 0) == $c;
+		push(@codes, $c);
+		push(@ranges, [$i, $j]);
+		$i = $j;
+	}
+	next unless @codes;
+
+	my $b = find_base(@codes);
+
+	$base[$s] = $b;
+	extend($b + $codes[-1]);
+	for my $k (0 .. $#codes)
+	{
+		my $t = $b + $codes[$k];
+
+		free_remove($t);
+		$check[$t] = $s;
+		if ($codes[$k] == 0)
+		{
+			$base[$t] = -($offset[$ranges[$k][0]] + 1);
+		}
+		else
+		{
+			push(@queue, [$t, $depth + 1, @{ $ranges[$k] }]);
+		}
+	}
+
+	free_remove($free_head) while $free_head != -1 && $free_head < $size - WINDOW;
+}
+
+my $nunits = $size;
+
+binmode(STDOUT);
+print pack('a8 V4', MAGIC, $nunits, scalar @keys, length($values), 0);
+for (my $i = 0; $i < $nunits; $i++)
+{
+	print pack('l< V', $base[$i] // 0, $check[$i] // 0);
+}
+print $values;
+
+printf(STDERR "%d words, %d units\n", scalar @keys, $nunits);
@@ -0,0 +1,197 @@
+-- complain if script is sourced in psql, rather than via CREATE EXTENSION
+\echo Use "ALTER EXTENSION textsearch_ko UPDATE TO '1.1'" to load this file. \quit
+
+--
+-- Functions from 1.0 are parallel safe
+--
+
+ALTER FUNCTION ts_mecabko_start(internal, int4) PARALLEL SAFE;
+ALTER FUNCTION ts_mecabko_gettoken(internal, internal, internal) PARALLEL SAFE;
+ALTER FUNCTION ts_mecabko_end(internal) PARALLEL SAFE;
+ALTER FUNCTION ts_mecabko_lexize(internal, internal, internal, internal) PARALLEL SAFE;
+ALTER FUNCTION mecabko_analyze(text) PARALLEL SAFE;
+ALTER FUNCTION korean_normalize(text) PARALLEL SAFE;
+
+--
+-- Headline for the korean parser, init for the mecabko template.
+-- ALTER TEXT SEARCH PARSER/TEMPLATE cannot change these, so update the
+-- catalogs directly.  prsd_headline is pinned, so there is no old
+-- dependency to remove.
+--
+
+CREATE FUNCTION ts_mecabko_headline(internal, internal, tsquery)
+    RETURNS internal
+    AS '$libdir/ts_mecab_ko'
+    LANGUAGE 'c' STRICT PARALLEL SAFE;
+
+UPDATE pg_catalog.pg_ts_parser
+    SET prsheadline = 'ts_mecabko_headline(internal, internal, tsquery)'::pg_catalog.regprocedure
+    WHERE oid = (SELECT d.objid FROM pg_catalog.pg_depend d
+                     JOIN pg_catalog.pg_ts_parser p ON p.oid = d.objid
+                 WHERE d.classid = 'pg_catalog.pg_ts_parser'::pg_catalog.regclass
+                   AND d.refclassid = 'pg_catalog.pg_extension'::pg_catalog.regclass
+                   AND d.refobjid = (SELECT oid FROM pg_catalog.pg_extension
+                                     WHERE extname = 'textsearch_ko')
+                   AND d.deptype = 'e'
+                   AND p.prsname = 'korean');
+
+INSERT INTO pg_catalog.pg_depend
+    SELECT 'pg_catalog.pg_ts_parser'::pg_catalog.regclass, p.oid, 0,
+           'pg_catalog.pg_proc'::pg_catalog.regclass, p.prsheadline, 0, 'n'
+    FROM pg_catalog.pg_ts_parser p
+    WHERE p.prsheadline = 'ts_mecabko_headline(internal, internal, tsquery)'::pg_catalog.regprocedure;
+
+CREATE FUNCTION ts_mecabko_init(internal)
+    RETURNS internal
+    AS '$libdir/ts_mecab_ko'
+    LANGUAGE 'c' STRICT PARALLEL SAFE;
+
+UPDATE pg_catalog.pg_ts_template
+    SET tmplinit = 'ts_mecabko_init(internal)'::pg_catalog.regprocedure
+    WHERE tmpllexize = 'ts_mecabko_lexize(internal, internal, internal, internal)'::pg_catalog.regprocedure;
+
+INSERT INTO pg_catalog.pg_depend
+    SELECT 'pg_catalog.pg_ts_template'::pg_catalog.regclass, t.oid, 0,
+           'pg_catalog.pg_proc'::pg_catalog.regclass, t.tmplinit, 0, 'n'
+    FROM pg_catalog.pg_ts_template t
+    WHERE t.tmplinit = 'ts_mecabko_init(internal)'::pg_catalog.regprocedure;
+
+--
+-- Bigram parser and configuration
+--
+
+CREATE FUNCTION ts_mecabko_bigram_start(internal, int4)
+    RETURNS internal
+    AS '$libdir/ts_mecab_ko'
+    LANGUAGE 'c' STRICT PARALLEL SAFE;
+
+-- No HEADLINE: bigrams overlap, use korean_headline() with the korean parser.
+CREATE TEXT SEARCH PARSER korean_bigram (
+    START    = ts_mecabko_bigram_start,
+    GETTOKEN = ts_mecabko_gettoken,
+    END      = ts_mecabko_end,
+    LEXTYPES = pg_catalog.prsd_lextype
+);
+COMMENT ON TEXT SEARCH PARSER korean_bigram IS
+    'korean bigram parser without morphological analysis';
+
+CREATE TEXT SEARCH CONFIGURATION korean_bigram (PARSER = korean_bigram);
+COMMENT ON TEXT SEARCH CONFIGURATION korean_bigram IS
+    'configuration for korean language, bigrams without morphological analysis';
+
+ALTER TEXT SEARCH CONFIGURATION korean_bigram ADD MAPPING
+    FOR email, url, url_path, host, file, version,
+        sfloat, float, int, uint,
+        numword, hword_numpart, numhword,
+        word, hword_part, hword
+    WITH simple;
+
+ALTER TEXT SEARCH CONFIGURATION korean_bigram ADD MAPPING
+    FOR asciiword, hword_asciipart, asciihword
+    WITH english_stem;
+
+--
+-- Utility functions
+--
+
+CREATE FUNCTION mecabko_tokens(
+        text,
+        OUT surface text,
+        OUT pos text,
+        OUT basic text,
+        OUT byte_start int4,
+        OUT byte_end int4)
+    RETURNS SETOF record
+    AS '$libdir/ts_mecab_ko'
+    LANGUAGE 'c' IMMUTABLE STRICT PARALLEL SAFE;
+
+-- hanja2hangul gained the use_mecab argument and a new reading table.
+-- Drop indexes and views that use it before updating, and recreate them after.
+DROP FUNCTION hanja2hangul(text);
+
+CREATE FUNCTION hanja2hangul(text, use_mecab boolean DEFAULT false)
+    RETURNS text
+    AS '$libdir/ts_mecab_ko'
+    LANGUAGE 'c' IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE FUNCTION korean_autocomplete_query(text)
+    RETURNS tsquery
+    AS '$libdir/ts_mecab_ko'
+    LANGUAGE 'c' IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE FUNCTION korean_bigram_query(regconfig, text)
+    RETURNS tsquery
+    AS '$libdir/ts_mecab_ko', 'korean_bigram_query_byid'
+    LANGUAGE 'c' IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE FUNCTION korean_bigram_query(text)
+    RETURNS tsquery
+    AS '$libdir/ts_mecab_ko'
+    LANGUAGE 'c' STABLE STRICT PARALLEL SAFE;
+
+CREATE FUNCTION korean_headline(regconfig, text, tsquery, text DEFAULT '')
+    RETURNS text
+    AS '$libdir/ts_mecab_ko', 'korean_headline_byid'
+    LANGUAGE 'c' IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE FUNCTION korean_headline(text, tsquery, text DEFAULT '')
+    RETURNS text
+    AS '$libdir/ts_mecab_ko'
+    LANGUAGE 'c' STABLE STRICT PARALLEL SAFE;
+
+CREATE FUNCTION korean_to_tsvector(regconfig, text[])
+    RETURNS tsvector[]
+    AS '$libdir/ts_mecab_ko', 'korean_to_tsvector_byid'
+    LANGUAGE 'c' IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE FUNCTION korean_to_tsvector(text[])
+    RETURNS tsvector[]
+    AS '$libdir/ts_mecab_ko'
+    LANGUAGE 'c' STABLE STRICT PARALLEL SAFE;
+
+CREATE FUNCTION korean_tsvector_update_trigger()
+    RETURNS trigger
+    AS '$libdir/ts_mecab_ko'
+    LANGUAGE 'c';
+
+CREATE FUNCTION mecabko_cache_stats(
+        OUT hits int8,
+        OUT misses int8,
+        OUT entries int4,
+        OUT bytes int8)
+    RETURNS record
+    AS '$libdir/ts_mecab_ko'
+    LANGUAGE 'c' VOLATILE STRICT PARALLEL RESTRICTED;
+
+CREATE FUNCTION textsearch_ko_stats(
+        all_backends boolean DEFAULT false,
+        OUT documents int8,
+        OUT input_bytes int8,
+        OUT normalized_bytes int8,
+        OUT mecab_nodes int8,
+        OUT tokens int8,
+        OUT filtered int8,
+        OUT inflect_expansions int8,
+        OUT lexemes int8,
+        OUT over_budget int8,
+        OUT normalize_time float8,
+        OUT mecab_time float8,
+        OUT lexize_time float8,
+        OUT stats_reset timestamptz)
+    RETURNS record
+    AS '$libdir/ts_mecab_ko'
+    LANGUAGE 'c' VOLATILE STRICT PARALLEL RESTRICTED;
+
+CREATE FUNCTION textsearch_ko_stats_reset(all_backends boolean DEFAULT false)
+    RETURNS void
+    AS '$libdir/ts_mecab_ko'
+    LANGUAGE 'c' VOLATILE STRICT;
+
+REVOKE ALL ON FUNCTION textsearch_ko_stats_reset(boolean) FROM PUBLIC;
+
+CREATE FUNCTION textsearch_ko_reload_dictionary()
+    RETURNS int8
+    AS '$libdir/ts_mecab_ko'
+    LANGUAGE 'c' VOLATILE STRICT;
+
+REVOKE ALL ON FUNCTION textsearch_ko_reload_dictionary() FROM PUBLIC;
@@ -0,0 +1,236 @@
+-- complain if script is sourced in psql, rather than via CREATE EXTENSION
+\echo Use "CREATE EXTENSION textsearch_ko" to load this file. \quit
+
+--
+-- Korean text parser
+--
+
+CREATE FUNCTION ts_mecabko_start(internal, int4)
+    RETURNS internal
+    AS '$libdir/ts_mecab_ko'
+    LANGUAGE 'c' STRICT PARALLEL SAFE;
+
+CREATE FUNCTION ts_mecabko_gettoken(internal, internal, internal)
+    RETURNS internal
+    AS '$libdir/ts_mecab_ko'
+    LANGUAGE 'c' STRICT PARALLEL SAFE;
+
+CREATE FUNCTION ts_mecabko_end(internal)
+    RETURNS void
+    AS '$libdir/ts_mecab_ko'
+    LANGUAGE 'c' STRICT PARALLEL SAFE;
+
+CREATE FUNCTION ts_mecabko_headline(internal, internal, tsquery)
+    RETURNS internal
+    AS '$libdir/ts_mecab_ko'
+    LANGUAGE 'c' STRICT PARALLEL SAFE;
+
+CREATE TEXT SEARCH PARSER korean (
+    START    = ts_mecabko_start,
+    GETTOKEN = ts_mecabko_gettoken,
+    END      = ts_mecabko_end,
+    HEADLINE = ts_mecabko_headline,
+    LEXTYPES = pg_catalog.prsd_lextype
+);
+COMMENT ON TEXT SEARCH PARSER korean IS
+    'korean word parser';
+
+CREATE FUNCTION ts_mecabko_bigram_start(internal, int4)
+    RETURNS internal
+    AS '$libdir/ts_mecab_ko'
+    LANGUAGE 'c' STRICT PARALLEL SAFE;
+
+-- No HEADLINE: bigrams overlap, use korean_headline() with the korean parser.
+CREATE TEXT SEARCH PARSER korean_bigram (
+    START    = ts_mecabko_bigram_start,
+    GETTOKEN = ts_mecabko_gettoken,
+    END      = ts_mecabko_end,
+    LEXTYPES = pg_catalog.prsd_lextype
+);
+COMMENT ON TEXT SEARCH PARSER korean_bigram IS
+    'korean bigram parser without morphological analysis';
+
+--
+-- Korean text lexizer
+--
+
+CREATE FUNCTION ts_mecabko_init(internal)
+    RETURNS internal
+    AS '$libdir/ts_mecab_ko'
+    LANGUAGE 'c' STRICT PARALLEL SAFE;
+
+CREATE FUNCTION ts_mecabko_lexize(internal, internal, internal, internal)
+    RETURNS internal
+    AS '$libdir/ts_mecab_ko'
+    LANGUAGE 'c' STRICT PARALLEL SAFE;
+
+CREATE TEXT SEARCH TEMPLATE mecabko (
+	INIT = ts_mecabko_init,
+	LEXIZE = ts_mecabko_lexize
+);
+
+CREATE TEXT SEARCH DICTIONARY korean_stem (
+	TEMPLATE = mecabko
+);
+
+--
+-- Korean text configuration
+--
+
+CREATE TEXT SEARCH CONFIGURATION korean (PARSER = korean);
+COMMENT ON TEXT SEARCH CONFIGURATION korean IS
+    'configuration for korean language';
+
+ALTER TEXT SEARCH CONFIGURATION korean ADD MAPPING
+    FOR email, url, url_path, host, file, version,
+        sfloat, float, int, uint,
+        numword, hword_numpart, numhword
+    WITH simple;
+
+-- Default configuration is Korean-English.
+-- Replace english_stem if you use other language.
+ALTER TEXT SEARCH CONFIGURATION korean ADD MAPPING
+    FOR asciiword, hword_asciipart, asciihword
+    WITH english_stem;
+
+ALTER TEXT SEARCH CONFIGURATION korean ADD MAPPING
+    FOR word, hword_part, hword
+    WITH korean_stem;
+
+CREATE TEXT SEARCH CONFIGURATION korean_bigram (PARSER = korean_bigram);
+COMMENT ON TEXT SEARCH CONFIGURATION korean_bigram IS
+    'configuration for korean language, bigrams without morphological analysis';
+
+ALTER TEXT SEARCH CONFIGURATION korean_bigram ADD MAPPING
+    FOR email, url, url_path, host, file, version,
+        sfloat, float, int, uint,
+        numword, hword_numpart, numhword,
+        word, hword_part, hword
+    WITH simple;
+
+ALTER TEXT SEARCH CONFIGURATION korean_bigram ADD MAPPING
+    FOR asciiword, hword_asciipart, asciihword
+    WITH english_stem;
+
+--
+-- Utility functions
+--
+
+CREATE FUNCTION mecabko_analyze(
+        text,
+        OUT word text,
+        OUT type text,
+        OUT part1st text,
+        OUT partlast text,
+        OUT pronounce text,
+        OUT conjtype text,
+        OUT conjugation text,
+        OUT basic text,
+        OUT detail text,
+        OUT lucene text)
+    RETURNS SETOF record
+    AS '$libdir/ts_mecab_ko'
+    LANGUAGE 'c' IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE FUNCTION mecabko_tokens(
+        text,
+        OUT surface text,
+        OUT pos text,
+        OUT basic text,
+        OUT byte_start int4,
+        OUT byte_end int4)
+    RETURNS SETOF record
+    AS '$libdir/ts_mecab_ko'
+    LANGUAGE 'c' IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE FUNCTION korean_normalize(text)
+    RETURNS text
+    AS '$libdir/ts_mecab_ko'
+    LANGUAGE 'c' IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE FUNCTION hanja2hangul(text, use_mecab boolean DEFAULT false)
+    RETURNS text
+    AS '$libdir/ts_mecab_ko'
+    LANGUAGE 'c' IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE FUNCTION korean_autocomplete_query(text)
+    RETURNS tsquery
+    AS '$libdir/ts_mecab_ko'
+    LANGUAGE 'c' IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE FUNCTION korean_bigram_query(regconfig, text)
+    RETURNS tsquery
+    AS '$libdir/ts_mecab_ko', 'korean_bigram_query_byid'
+    LANGUAGE 'c' IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE FUNCTION korean_bigram_query(text)
+    RETURNS tsquery
+    AS '$libdir/ts_mecab_ko'
+    LANGUAGE 'c' STABLE STRICT PARALLEL SAFE;
+
+CREATE FUNCTION korean_headline(regconfig, text, tsquery, text DEFAULT '')
+    RETURNS text
+    AS '$libdir/ts_mecab_ko', 'korean_headline_byid'
+    LANGUAGE 'c' IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE FUNCTION korean_headline(text, tsquery, text DEFAULT '')
+    RETURNS text
+    AS '$libdir/ts_mecab_ko'
+    LANGUAGE 'c' STABLE STRICT PARALLEL SAFE;
+
+CREATE FUNCTION korean_to_tsvector(regconfig, text[])
+    RETURNS tsvector[]
+    AS '$libdir/ts_mecab_ko', 'korean_to_tsvector_byid'
+    LANGUAGE 'c' IMMUTABLE STRICT PARALLEL SAFE;
+
+CREATE FUNCTION korean_to_tsvector(text[])
+    RETURNS tsvector[]
+    AS '$libdir/ts_mecab_ko'
+    LANGUAGE 'c' STABLE STRICT PARALLEL SAFE;
+
+CREATE FUNCTION korean_tsvector_update_trigger()
+    RETURNS trigger
+    AS '$libdir/ts_mecab_ko'
+    LANGUAGE 'c';
+
+CREATE FUNCTION mecabko_cache_stats(
+        OUT hits int8,
+        OUT misses int8,
+        OUT entries int4,
+        OUT bytes int8)
+    RETURNS record
+    AS '$libdir/ts_mecab_ko'
+    LANGUAGE 'c' VOLATILE STRICT PARALLEL RESTRICTED;
+
+CREATE FUNCTION textsearch_ko_stats(
+        all_backends boolean DEFAULT false,
+        OUT documents int8,
+        OUT input_bytes int8,
+        OUT normalized_bytes int8,
+        OUT mecab_nodes int8,
+        OUT tokens int8,
+        OUT filtered int8,
+        OUT inflect_expansions int8,
+        OUT lexemes int8,
+        OUT over_budget int8,
+        OUT normalize_time float8,
+        OUT mecab_time float8,
+        OUT lexize_time float8,
+        OUT stats_reset timestamptz)
+    RETURNS record
+    AS '$libdir/ts_mecab_ko'
+    LANGUAGE 'c' VOLATILE STRICT PARALLEL RESTRICTED;
+
+CREATE FUNCTION textsearch_ko_stats_reset(all_backends boolean DEFAULT false)
+    RETURNS void
+    AS '$libdir/ts_mecab_ko'
+    LANGUAGE 'c' VOLATILE STRICT;
+
+REVOKE ALL ON FUNCTION textsearch_ko_stats_reset(boolean) FROM PUBLIC;
+
+CREATE FUNCTION textsearch_ko_reload_dictionary()
+    RETURNS int8
+    AS '$libdir/ts_mecab_ko'
+    LANGUAGE 'c' VOLATILE STRICT;
+
+REVOKE ALL ON FUNCTION textsearch_ko_reload_dictionary() FROM PUBLIC;
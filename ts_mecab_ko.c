@@ -9,17 +9,58 @@
  */
 #include "postgres.h"
 
+#if PG_VERSION_NUM >= 130000
+#include "access/detoast.h"
+#else
+#include "access/tuptoaster.h"
+#endif
+#include "access/hash.h"
 #include "access/heapam.h"
 #include "access/htup_details.h"
+#include "access/xact.h"
 #include "catalog/pg_type.h"
+#include "commands/defrem.h"
+#include "commands/trigger.h"
+#include "executor/spi.h"
 #include "funcapi.h"
+#include "lib/ilist.h"
+#include "miscadmin.h"
 #include "mb/pg_wchar.h"
+#include "parser/parse_coerce.h"
+#include "port/atomics.h"
+#include "port/pg_bitutils.h"
+#include "portability/instr_time.h"
+#include "storage/ipc.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
+#include "tsearch/ts_cache.h"
+#include "tsearch/ts_locale.h"
 #include "tsearch/ts_public.h"
+#include "tsearch/ts_type.h"
 #include "tsearch/ts_utils.h"
+#include "utils/array.h"
 #include "utils/builtins.h"
+#include "utils/guc.h"
+#include "utils/hsearch.h"
+#include "utils/memutils.h"
+#include "utils/timestamp.h"
+#include "utils/tuplestore.h"
 
 #include "ts_mecab_ko.h"
+#include "hanja_table.h"
+#include <fcntl.h>
 #include <mecab.h>
+#include <pthread.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 PG_MODULE_MAGIC;
 
@@ -45,81 +86,568 @@ PG_MODULE_MAGIC;
 
 #define SPACE			12
 
+/* 헤드라인에서 따로 다루는 prsd 노드 형태들 */
+#define URL_T			5
+#define TAG_T			13
+#define ASCIIHWORD		16
+
 /* MeCab 에서 넘겨준 CSV 값들 (mecab-ko, mecab-ko-dic 자료기준) */
 #define NUM_CSV			9
+#define MECAB_POS		0	/* 품사 */
 #define MECAB_BASIC		3	/* 기본형 */
 #define MECAB_CONJTYPE		4	/* 용언활용 */
 #define MECAB_DETAIL		7	/* 활용정보 */
 
 #define SEPARATOR_CHAR	'\v'
 
+/*
+ * 품사 집합 - 품사 번호 (pos_tags 배열 위치) 를 비트로 쓴다
+ */
+typedef uint64 pos_set;
+
+#define POS_BIT(pos)		((pos) < 0 ? (pos_set) 0 : ((pos_set) 1) << (pos))
+#define POS_TAG_MAXLEN		7
+#define POS_HASH_SIZE		128
+
+/* 활용 형태 (CSV 의 MECAB_CONJTYPE 값) */
+#define CONJ_NONE			0
+#define CONJ_INFLECT		1	/* 용언 활용 */
+#define CONJ_COMPOUND		2	/* 복합명사 */
+#define CONJ_PREANALYSIS	3	/* 기분석 */
+
+/*
+ * mecab_field - CSV 값 하나의 위치, * 나 빈값이면 길이 0
+ */
+typedef struct mecab_field
+{
+	uint16		offset;		/* feature 안에서 위치 */
+	uint16		length;
+} mecab_field;
+
+/*
+ * mecab_piece - 활용 정보 (MECAB_DETAIL) 를 + 로 나눈 조각 하나
+ * "가깝/VA/..." 라면 surface 는 "가깝", tag 는 "VA"
+ */
+typedef struct mecab_piece
+{
+	uint16		offset;		/* feature 안에서 surface 위치 */
+	uint16		length;
+	uint16		tag_offset;	/* feature 안에서 품사 태그 위치 */
+	uint16		tag_length;
+	int			pos;		/* 품사 번호, 모르는 품사는 -1 */
+} mecab_piece;
+
+/*
+ * mecab_morph - mecab 노드 하나를 복사해 둔 것
+ * mecab 노드는 다음 분석 때 사라지므로 필요한 값만 옮겨 둔다.
+ * feature CSV 는 분석할 때 한번만 나눠서 fields, pieces 에 둔다.
+ */
+typedef struct mecab_morph
+{
+	int			offset;		/* 분석 문자열 안에서 surface 시작 위치 */
+	int			length;		/* surface 길이 */
+	int			pos;		/* 품사 번호, 모르는 품사는 -1 */
+	uint8		conjtype;	/* CONJ_* */
+	uint8		nfields;	/* CSV 값 갯수, 미등록어는 NUM_CSV 보다 작음 */
+	uint16		npieces;	/* 활용 정보 조각 갯수 */
+	const mecab_piece *pieces;
+	const char *feature;	/* CSV */
+	mecab_field	fields[NUM_CSV];
+} mecab_morph;
+
+#define morph_field_ptr(m, n)	((m)->feature + (m)->fields[n].offset)
+#define morph_is_inflect(m) \
+	((m)->conjtype == CONJ_INFLECT && (m)->npieces > 0)
+
+/* 분석 방식 */
+#define ANALYSIS_FULL		0	/* 문자열 전체를 mecab 으로 분석 */
+#define ANALYSIS_NATIVE		1	/* 멀티바이트 구간만 mecab 으로, 나머지는 prsd 로 */
+#define ANALYSIS_CHEAP		2	/* mecab 없이 멀티바이트 구간을 낱말 하나로, 나머지는 prsd 로 */
+#define ANALYSIS_BIGRAM		3	/* mecab 없이 멀티바이트 구간을 두 글자씩, 나머지는 prsd 로 */
+
+#define ANALYSIS_USES_MECAB(mode)	((mode) == ANALYSIS_FULL || (mode) == ANALYSIS_NATIVE)
+
+/*
+ * 한글 음절 U+AC00 ~ U+D7A3 = 0xAC00 + (초성 * 21 + 중성) * 28 + 종성
+ */
+#define HANGUL_BASE			0xAC00
+#define HANGUL_LAST			0xD7A3
+#define HANGUL_JUNG_COUNT	21
+#define HANGUL_JONG_COUNT	28
+#define HANGUL_CHO_UNIT		(HANGUL_JUNG_COUNT * HANGUL_JONG_COUNT)
+#define CHO_NIEUN			2
+#define CHO_RIEUL			5
+#define CHO_IEUNG			11
+#define CHO_DIGEUT			3
+#define CHO_JIEUT			12
+#define JONG_NIEUN			4
+/* 두음법칙에서 ㄹ, ㄴ 이 ㅇ 으로 바뀌는 중성: ㅑ ㅕ ㅖ ㅛ ㅠ ㅣ */
+#define DUEUM_JUNG_MASK		((1 << 2) | (1 << 6) | (1 << 7) | (1 << 12) | (1 << 17) | (1 << 20))
+
+/* 不 (통합, 호환 한자), 독음 불은 ㄷ, ㅈ 앞에서 부 */
+#define HANJA_BUL			0x4E0D
+#define HANJA_COMPAT_BUL	0xF967
+#define HANGUL_BU			0xBD80
+
+/* 한글 호환 자모 ㄱ (U+3131) ~ ㅎ (U+314E) 자음, ㅏ (U+314F) ~ ㅣ (U+3163) 모음 */
+#define JAMO_FIRST			0x3131
+#define JAMO_CONS_LAST		0x314E
+#define JAMO_VOWEL_FIRST	0x314F
+#define JAMO_LAST			0x3163
+
+/* 3byte 문자 첫 바이트로 한자, 한글 음절 후보 거르기 */
+#define IS_HANJA_LEAD(s) \
+	(((s)[0] >= 0xe4 && (s)[0] <= 0xe9) || \
+	 ((s)[0] == 0xef && (s)[1] >= 0xa4 && (s)[1] <= 0xab))
+#define IS_HANGUL_LEAD(s)	((s)[0] >= 0xea && (s)[0] <= 0xed)
+
+/*
+ * mecab_result - 문자열 하나의 분석 결과, 캐시 단위
+ * 한 덩어리로 할당하며, pieces, text, feature 들은 morphs 뒤에 이어 붙는다.
+ */
+typedef struct mecab_result
+{
+	uint32		hash;		/* 분석 문자열의 해시값 */
+	int			mode;		/* ANALYSIS_* */
+	int			refcount;	/* 사용 중이면 캐시에서 빼지 않음 */
+	bool		cached;		/* 캐시에 들어 있는가 */
+	uint32		epoch;		/* 분석한 mecab 모델 (model_epoch) */
+	dlist_node	lru;		/* 캐시 LRU 목록 */
+	Size		size;		/* 할당 크기 */
+	char	   *text;		/* 분석 문자열 */
+	int			textlen;
+	struct parser_token *tokens;	/* 파서 토큰들, 아직 안 만들었으면 NULL */
+	int			ntokens;
+	int			nmorphs;
+	mecab_morph	morphs[FLEXIBLE_ARRAY_MEMBER];
+} mecab_result;
+
+/*
+ * stop_entry - 검색 제외어 해시 집합의 칸 하나, word 가 NULL 이면 빈칸
+ */
+typedef struct stop_entry
+{
+	uint32		hash;
+	int			len;
+	char	   *word;
+} stop_entry;
+
+/*
+ * synonym_trie - 사전 옵션 synonyms 의 동의어 사전 파일 (synonym_trie.pl 로 만듦)
+ * 파일을 읽기 전용으로 mmap 하므로 백엔드들이 페이지 캐시를 같이 쓰고,
+ * 연결마다 파일을 읽어 들이지 않는다. 파일 형식은 synonym_trie.pl 참고
+ */
+#define SYNONYM_MAGIC		"KOTRIE1"
+
+typedef struct synonym_header
+{
+	char		magic[8];		/* SYNONYM_MAGIC */
+	uint32		nunits;			/* 더블 어레이 칸 수 */
+	uint32		nkeys;			/* 낱말 수 */
+	uint32		values_len;		/* 바꿀 낱말 목록 크기 */
+	uint32		reserved;
+} synonym_header;
+
+typedef struct synonym_unit
+{
+	int32		base;			/* 자식 칸 시작, 낱말 끝 칸이면 -(목록 위치 + 1) */
+	uint32		check;			/* 부모 칸, 0 이면 빈칸 */
+} synonym_unit;
+
+typedef struct synonym_trie
+{
+	struct synonym_trie *next;
+	dev_t		dev;			/* 같은 파일인지 볼 때 씀 */
+	ino_t		ino;
+	time_t		mtime;
+	off_t		size;
+	void	   *map;			/* mmap 한 파일 전체 */
+	int			refcount;		/* 이 파일을 쓰는 사전 수, 0 이 되면 풂 */
+	const synonym_unit *units;
+	uint32		nunits;
+	const char *values;			/* 낱말마다 NUL 로 끝낸 낱말들, 빈 문자열로 끝 */
+	uint32		values_len;
+} synonym_trie;
+
+/* 형태소 하나가 활용 정보 조각들 말고 더 넣을 수 있는 낱말 수 (자동 완성 묶음의 낱말, 초성, 자모) */
+#define MORPH_EXTRA_LEXEMES	3
+
+/* 복합명사 색인 방식, 사전 옵션 compound */
+#define COMPOUND_WHOLE		0	/* 복합명사 그대로 (무궁화) */
+#define COMPOUND_PARTS		1	/* 구성 명사들만 (무궁, 화) */
+#define COMPOUND_BOTH		2	/* 둘 다 */
+
+/*
+ * mecabko_dict - korean_stem 사전 설정
+ */
+typedef struct mecabko_dict
+{
+	pos_set		accept_pos;		/* 사전이 받아들이는 품사들 */
+	int			compound;		/* COMPOUND_* */
+	bool		choseong;		/* 명사의 초성 낱말 (ㅁㄱㅎ) 도 넣음 */
+	bool		jamo_prefix;	/* 명사의 자모 낱말 (ㅁㅜㄱㅜㅇㅎㅗㅏ) 도 넣음 */
+	int			min_length;		/* 낱말 최소 글자 수 */
+	int			max_length;		/* 낱말 최대 글자 수, 0 이면 제한 없음 */
+	int			nstops;			/* 검색 제외어 수 */
+	uint32		stop_mask;		/* 해시 칸 수 - 1 */
+	stop_entry *stops;			/* 검색 제외어 해시 집합, 없으면 NULL */
+	const synonym_trie *synonyms;	/* 동의어 사전, 없으면 NULL */
+} mecabko_dict;
+
+/*
+ * parser_token - 파서가 넘겨줄 토큰 하나
+ */
+typedef struct parser_token
+{
+	int			type;		/* lextype */
+	int			offset;		/* 분석 문자열 안에서 시작 위치 */
+	int			length;
+	const mecab_morph *morph;	/* mecab 형태소, 영숫자 토큰이면 NULL */
+} parser_token;
+
+/*
+ * token_buf - 토큰 배열을 만들 때 쓰는 버퍼
+ */
+typedef struct token_buf
+{
+	parser_token *tokens;
+	int			ntokens;
+	int			maxtokens;
+} token_buf;
+
+/*
+ * analysis_node - 분석 단위마다 mecab 노드를 잠시 옮겨 둔 것
+ * feature 는 모아 둔 feature 문자열들 안 위치
+ */
+typedef struct analysis_node
+{
+	int			offset;		/* 분석 문자열 안에서 surface 시작 위치 */
+	int			length;
+	int			feature;
+} analysis_node;
+
 /*
  * parser_data - 파싱 작업 중인 자료
  */
 typedef struct parser_data
 {
-	StringInfoData		str;
-	const mecab_node_t	*node;		/* mecab-ko 분석기에서 넘겨준 노드 */
-	Datum			ascprs;		/* ascii word parser */
-	const char		*last_node_pos;
+	mecab_result	   *result;		/* 지금 조각 분석 결과 */
+	mecab_result	   *prev;		/* 앞 조각 분석 결과 */
+	int					next;		/* 다음에 넘겨줄 tokens 위치 */
+	const char		   *input;		/* 아직 분석 안 한 입력 */
+	int					inputlen;
+	const char		   *doc;		/* 입력 전체 */
+	int					doclen;
+	int					ntokens;	/* 넘겨준 토큰 수 */
+	int					mode;		/* ANALYSIS_*, 예산을 넘으면 ANALYSIS_CHEAP */
+	int64				analyzed;	/* mecab 으로 분석한 입력 바이트 */
+	instr_time			elapsed;	/* 분석에 쓴 시간 */
+	dlist_node			node;		/* 파싱 중인 파서 목록 */
+	MemoryContext		cxt;		/* 파서와 캐시 안 한 분석 결과 */
+	MemoryContextCallback cleanup;	/* cxt 가 없어지면 parser_cleanup */
+	struct parse_record *record;	/* 파싱이 끝나면 적을 곳 */
 } parser_data;
 
+/*
+ * parse_record - 끝난 파싱
+ * hlparsetext 는 파서를 끝내고 바로 헤드라인 함수를 부르므로, 그때까지
+ * 원문이 남아 있어서 정리된 낱말들을 원문으로 되돌릴 수 있다.
+ */
+typedef struct parse_record
+{
+	const char		   *doc;		/* 원문, 없으면 NULL */
+	int					doclen;
+	int					ntokens;
+} parse_record;
+
+/*
+ * offset_map - normalize 결과 위치 -> 원문 위치
+ * 공백을 넣거나 길이가 다른 글자로 바꾼 곳마다 (결과 위치, 원문 위치) 를
+ * 적어 두고, 그 사이는 같은 거리만큼 떨어져 있다.
+ */
+typedef struct offset_map
+{
+	int				   *dst;
+	int				   *src;
+	int					n;
+	int					max;
+} offset_map;
+
+/*
+ * headline_opts - 헤드라인 옵션, ts_headline 과 같은 이름들
+ */
+typedef struct headline_opts
+{
+	int					max_words;
+	int					min_words;
+	int					max_fragments;
+	bool				highlight_all;
+} headline_opts;
+
+/*
+ * headline_state - 낱말들을 한번 훑으며 어절 단위로 조각 고르기
+ */
+typedef struct headline_state
+{
+	int					next;			/* 다음에 볼 낱말 */
+	int					eojeol;			/* 지금 어절 첫 낱말, 없으면 -1 */
+	int					eojeol_words;	/* 지금 어절 단어 수 */
+	bool				eojeol_match;	/* 지금 어절에 검색어가 있음 */
+	int					frag;			/* 열린 조각 첫 낱말, 없으면 -1 */
+	int					frag_last;		/* 열린 조각 마지막 낱말 */
+	int					frag_words;		/* 열린 조각 단어 수 */
+	int					nfrags;			/* 닫은 조각 수 */
+	bool				done;			/* 조각을 다 찾음 */
+} headline_state;
+
+/*
+ * chunk_reader - 큰 text 인자를 textsearch_ko.chunk_size 조각씩 읽기
+ */
+typedef struct chunk_reader
+{
+	struct varlena	   *datum;		/* 조각씩 읽어 올 toast 값, 아니면 NULL */
+	int					chunk;		/* 조각 크기, 0 이면 한 조각 */
+	text			   *text;		/* 한번에 풀어둔 값 */
+	const char		   *data;		/* text 내용 */
+	text			   *slice;		/* 지금 읽은 조각 */
+	int					size;		/* 전체 바이트 수 */
+	int					offset;		/* 다음 조각 위치 */
+} chunk_reader;
+
 PG_FUNCTION_INFO_V1(ts_mecabko_start);
+PG_FUNCTION_INFO_V1(ts_mecabko_bigram_start);
 PG_FUNCTION_INFO_V1(ts_mecabko_gettoken);
 PG_FUNCTION_INFO_V1(ts_mecabko_end);
+PG_FUNCTION_INFO_V1(ts_mecabko_headline);
+PG_FUNCTION_INFO_V1(ts_mecabko_init);
 PG_FUNCTION_INFO_V1(ts_mecabko_lexize);
 PG_FUNCTION_INFO_V1(mecabko_analyze);
+PG_FUNCTION_INFO_V1(mecabko_tokens);
 PG_FUNCTION_INFO_V1(korean_normalize);
 PG_FUNCTION_INFO_V1(hanja2hangul);
+PG_FUNCTION_INFO_V1(korean_autocomplete_query);
+PG_FUNCTION_INFO_V1(korean_bigram_query);
+PG_FUNCTION_INFO_V1(korean_bigram_query_byid);
+PG_FUNCTION_INFO_V1(korean_headline);
+PG_FUNCTION_INFO_V1(korean_headline_byid);
+PG_FUNCTION_INFO_V1(korean_to_tsvector);
+PG_FUNCTION_INFO_V1(korean_to_tsvector_byid);
+PG_FUNCTION_INFO_V1(korean_tsvector_update_trigger);
+PG_FUNCTION_INFO_V1(mecabko_cache_stats);
+PG_FUNCTION_INFO_V1(textsearch_ko_stats);
+PG_FUNCTION_INFO_V1(textsearch_ko_stats_reset);
+PG_FUNCTION_INFO_V1(textsearch_ko_reload_dictionary);
 
 extern void PGDLLEXPORT _PG_init(void);
 extern void PGDLLEXPORT _PG_fini(void);
 extern Datum PGDLLEXPORT ts_mecabko_start(PG_FUNCTION_ARGS);
+extern Datum PGDLLEXPORT ts_mecabko_bigram_start(PG_FUNCTION_ARGS);
 extern Datum PGDLLEXPORT ts_mecabko_gettoken(PG_FUNCTION_ARGS);
 extern Datum PGDLLEXPORT ts_mecabko_end(PG_FUNCTION_ARGS);
+extern Datum PGDLLEXPORT ts_mecabko_headline(PG_FUNCTION_ARGS);
+extern Datum PGDLLEXPORT ts_mecabko_init(PG_FUNCTION_ARGS);
 extern Datum PGDLLEXPORT ts_mecabko_lexize(PG_FUNCTION_ARGS);
 extern Datum PGDLLEXPORT mecabko_analyze(PG_FUNCTION_ARGS);
+extern Datum PGDLLEXPORT mecabko_tokens(PG_FUNCTION_ARGS);
 extern Datum PGDLLEXPORT korean_normalize(PG_FUNCTION_ARGS);
 extern Datum PGDLLEXPORT hanja2hangul(PG_FUNCTION_ARGS);
+extern Datum PGDLLEXPORT korean_autocomplete_query(PG_FUNCTION_ARGS);
+extern Datum PGDLLEXPORT korean_bigram_query(PG_FUNCTION_ARGS);
+extern Datum PGDLLEXPORT korean_bigram_query_byid(PG_FUNCTION_ARGS);
+extern Datum PGDLLEXPORT korean_headline(PG_FUNCTION_ARGS);
+extern Datum PGDLLEXPORT korean_headline_byid(PG_FUNCTION_ARGS);
+extern Datum PGDLLEXPORT korean_to_tsvector(PG_FUNCTION_ARGS);
+extern Datum PGDLLEXPORT korean_to_tsvector_byid(PG_FUNCTION_ARGS);
+extern Datum PGDLLEXPORT korean_tsvector_update_trigger(PG_FUNCTION_ARGS);
+extern Datum PGDLLEXPORT mecabko_cache_stats(PG_FUNCTION_ARGS);
+extern Datum PGDLLEXPORT textsearch_ko_stats(PG_FUNCTION_ARGS);
+extern Datum PGDLLEXPORT textsearch_ko_stats_reset(PG_FUNCTION_ARGS);
+extern Datum PGDLLEXPORT textsearch_ko_reload_dictionary(PG_FUNCTION_ARGS);
 
-static bool	feature(const mecab_node_t *node, int n, const char **t, int *tlen);
-static void	normalize(StringInfo dst, const char *src, size_t srclen, append_t append);
+static mecab_result *analysis_acquire(const char *str, int len, int mode);
+static void	analysis_release(mecab_result *result);
+static void	analysis_tokenize(mecab_result *result);
+static parser_data *parser_start(const char *input, int len, int mode);
+static bool	parser_next_chunk(parser_data *parser);
+static bool	parser_over_budget(const parser_data *parser);
+static void	parser_cleanup(void *arg);
+static const mecab_morph *parser_lookup_morph(const char *t, int tlen);
+static int	chunk_boundary(const char *s, int len);
+static int	parser_chunk_length(const char *s, int len);
+static void	chunk_reader_init(chunk_reader *reader, Datum datum);
+static bool	chunk_reader_next(chunk_reader *reader, const char **s, int *len);
+static void	chunk_reader_end(chunk_reader *reader, Datum datum);
+static int	morph_lexemes(const mecab_morph *m, const mecabko_dict *dict,
+						  const char *surface, TSLexeme *res);
+static int	morph_piece_lexemes(const mecab_morph *m, const mecabko_dict *dict,
+								uint16 nvariant, TSLexeme *res);
+static int	jamo_lexemes(const mecabko_dict *dict, const char *t, int tlen,
+						 uint16 nvariant, TSLexeme *res);
+static TSLexeme *lexeme_combine(TSLexeme *res, const int *nper, int nmorphs,
+								int *nres);
+static bool	jamo_choseong(StringInfo dst, const char *s, int len);
+static bool	jamo_keys(StringInfo dst, const char *s, int len);
+static void	tsquery_append_lexeme(StringInfo dst, const char *s, int len);
+static TSQuery tsquery_empty(void);
+static void	dict_load_stopwords(mecabko_dict *dict, const char *name);
+static const synonym_trie *synonym_trie_open(const char *name);
+static void synonym_trie_release(void *arg);
+static TSLexeme *synonym_expand(const synonym_trie *trie, TSLexeme *res, int *nres);
+static bool	dict_accept_word(const mecabko_dict *dict, const char *t, int tlen);
+static int	morph_parse(mecab_morph *m, mecab_piece *pieces);
+static bool	morph_field(const mecab_morph *m, int n, const char **t, int *tlen);
+static void	normalize(StringInfo dst, const char *src, size_t srclen,
+					  offset_map *map);
+static void	offset_map_init(offset_map *map);
+static void	mecab_model_settings_save(uint64 generation);
+static uint64	mecab_model_stamp(void);
+static void	analysis_cache_clear(void);
+static int	offset_map_lookup(const offset_map *map, int dst);
 static char	*lexize(const char *str, size_t len);
-static bool	accept_mecab_ko_part(const char *str, int slen);
-static void	appendString(StringInfo dst, const unsigned char *src, int srclen);
-static bool	ismbascii(const unsigned char *s, unsigned char *c, int *cnt);
+static void	pos_hash_init(void);
+static int	pos_lookup(const char *str, int len);
+static pos_set	pos_set_parse(const char *list);
+static void	normalize_init(void);
+static const char *ascii_run_end(const char *s, const char *end);
+static void	hanja_convert(StringInfo dst, const char *src, int srclen,
+						  pg_wchar *prev_hangul);
+
+/* mecab-ko-dic 품사 태그들, 배열 위치가 품사 번호 (64개 까지) */
+static const char *pos_tags[] = {
+	"NNG", "NNP", "NNB", "NNBC", "NR", "NP",
+	"VV", "VA", "VX", "VCP", "VCN",
+	"MM", "MAG", "MAJ", "IC",
+	"JKS", "JKC", "JKG", "JKO", "JKB", "JKV", "JKQ", "JX", "JC",
+	"EP", "EF", "EC", "ETN", "ETM",
+	"XPN", "XSN", "XSV", "XSA", "XR",
+	"SF", "SE", "SSO", "SSC", "SC", "SY", "SL", "SH", "SN",
+	"UNKNOWN"
+};
+
+/* 품사 태그 문자열 -> 품사 번호 + 1, 0 이면 빈칸 */
+static int8	pos_hash_table[POS_HASH_SIZE];
+
+/* mecab-ko-dic 에서 사용할 품사들, 사전 옵션 accept_pos 가 없을 때 기본값 */
+static const char *accept_parts_of_speech =
+	"NNG,NNP,NNB,NNBC,NR,VV,VA,MM,MAG,XSN,XR,SH";
+
+static pos_set	default_accept_pos;
 
-/* mecab-ko-dic 에서 사용할 품사들 */
-static char *accept_parts_of_speech[13] = {
-	"NNG" ,"NNP" ,"NNB" ,"NNBC" ,"NR" ,"VV" ,"VA" ,"MM" ,"MAG" ,"XSN" ,"XR" ,"SH", ""
+/* 초성, 자모 낱말을 만들 품사들 */
+static const char *jamo_parts_of_speech = "NNG,NNP";
+
+static pos_set	jamo_pos;
+
+/* 옵션 없이 쓸 때 (ts_mecabko_init 을 거치지 않은 사전) 설정 */
+static mecabko_dict default_dict;
+
+/* 파서 토큰 분리 방식, GUC */
+static int	parser_tokenizer = ANALYSIS_NATIVE;
+
+/* 문자정리 때 한자를 한글로 바꿀지, GUC */
+static bool	normalize_hanja = false;
+
+static const struct config_enum_entry tokenizer_options[] = {
+	{"native", ANALYSIS_NATIVE, false},
+	{"prsd", ANALYSIS_FULL, false},
+	{NULL, 0, false}
 };
 
+/* 파싱 중인 파서들, 사전 처리 함수가 토큰의 형태소를 찾을 때 씀 */
+static dlist_head	active_parsers = DLIST_STATIC_INIT(active_parsers);
+
+/* 마지막으로 끝난 파싱, ts_headline 이 부르는 헤드라인 함수가 씀 */
+static parse_record	last_parse;
+
+/* 새 파서가 끝난 파싱을 적을 곳, korean_headline_byid 는 자기 것으로 바꿈 */
+static parse_record *parse_target = &last_parse;
+
 static char *ascii_sign = "`~!@#$%^&*()-=\\_+|[]{};':\",.<>/? ";
 
-/* mecab */
-static mecab_t	   *_mecab;
+/* mecab 모델, 백엔드 안의 분석기들이 같이 씀 */
+static mecab_model_t *_mecab_model;
+
+/*
+ * mecab 사전 설정
+ * GUC 가 바뀌거나 (설정 다시 읽기) textsearch_ko_reload_dictionary() 로
+ * 공유 사전 세대가 바뀌면 다음 분석 때 모델을 새로 만든다.
+ */
+static char	   *mecab_dicdir = NULL;		/* GUC, 비어 있으면 mecabrc 설정 */
+static char	   *mecab_userdic = NULL;		/* GUC, 쉼표로 나눈 사용자 사전들 */
+static char	   *model_dicdir = NULL;		/* 지금 모델을 만든 설정 */
+static char	   *model_userdic = NULL;
+static uint64	model_generation = 0;		/* 지금 모델이 따른 공유 사전 세대 */
+static uint32	model_epoch = 0;			/* 모델을 바꿀 때마다 늘어남 */
+static uint64	model_stamp = 0;			/* 지금 모델 사전 파일들, mecab_model_stamp */
+static bool		mecab_prewarm = true;		/* GUC */
+
+/*
+ * dict_shared_state - 공유 사전 세대, shared_preload_libraries 로 올렸을 때만
+ */
+typedef struct dict_shared_state
+{
+	pg_atomic_uint64 generation;
+} dict_shared_state;
+
+static dict_shared_state *dict_shared = NULL;
+
+/*
+ * mecab_worker - 분석기 하나 (tagger + lattice)
+ * mecab_workers[0] 은 백엔드가 직접 쓰고, 나머지는 분석 스레드들 몫
+ */
+typedef struct mecab_worker
+{
+	mecab_t			   *tagger;
+	mecab_lattice_t	   *lattice;
+	const char		   *input;		/* 분석할 조각 */
+	size_t				len;
+	bool				ok;			/* 분석 성공 */
+	pthread_t			thread;
+} mecab_worker;
+
+#define MAX_ANALYSIS_THREADS	16
+
+static mecab_worker	mecab_workers[MAX_ANALYSIS_THREADS + 1];
+static int			mecab_nthreads = 0;		/* 띄운 분석 스레드 수 */
+static bool			mecab_pool_failed = false;
+
+/*
+ * 분석 스레드 작업 전달
+ * 작업 번호가 바뀌면 번호가 pool_njobs 보다 작은 스레드들이 자기 조각을 분석하고,
+ * 마지막으로 끝난 스레드가 백엔드를 깨움
+ */
+static pthread_mutex_t pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pool_work = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t pool_done = PTHREAD_COND_INITIALIZER;
+static uint64		pool_generation = 0;	/* 작업 번호 */
+static int			pool_njobs = 0;			/* 조각 수, mecab_workers[0] 포함 */
+static int			pool_pending = 0;		/* 안 끝난 스레드 조각 수 */
+
+static int			analysis_threads = 0;				/* GUC */
+static int			analysis_parallel_threshold = 256;	/* GUC, kB 단위 */
 
 /*
  * mecab_assert - mecab 오류 처리
  */
-#define mecab_assert(expr) \
+#define mecab_assert(expr, msg) \
 	if (expr); else \
 		ereport(ERROR, \
 			(errcode(ERRCODE_EXTERNAL_ROUTINE_EXCEPTION), \
-			 errmsg("mecab: %s", mecab_strerror(_mecab))))
+			 errmsg("mecab: %s", (msg))))
 
 /*
  * mecab_acquire - 사전 인코딩과 DB 인코딩이 다르면 종료
+ * 백엔드가 쓸 분석기를 돌려줌
  */
 
 static int	mecab_dict_encoding = -1;
 
-static mecab_t *
+static mecab_worker *
 mecab_acquire(void)
 {
 	if (mecab_dict_encoding < 0)
 	{
-		const mecab_dictionary_info_t *dict = mecab_dictionary_info(_mecab);
+		const mecab_dictionary_info_t *dict = mecab_model_dictionary_info(_mecab_model);
 		int		encoding = pg_char_to_encoding(dict->charset);
 
 		if (encoding != GetDatabaseEncoding())
@@ -133,603 +661,4898 @@ mecab_acquire(void)
 		mecab_dict_encoding = encoding;
 	}
 
-	return _mecab;
+	return &mecab_workers[0];
 }
 
 /*
- * _PG_init - 동적 모듈 초기화
+ * mecab_model_create - 사전 설정 GUC 로 mecab 모델 만들기, 실패하면 NULL
  */
-void
-_PG_init(void)
+static mecab_model_t *
+mecab_model_create(void)
 {
-	if (_mecab == NULL)
+	char	   *argv[5];
+	int			argc = 0;
+
+	argv[argc++] = "mecab";
+	if (mecab_dicdir != NULL && mecab_dicdir[0] != '\0')
+	{
+		argv[argc++] = "-d";
+		argv[argc++] = mecab_dicdir;
+	}
+	if (mecab_userdic != NULL && mecab_userdic[0] != '\0')
 	{
-		int			argc = 1;
-		char	   *argv[] = { "mecab" };
-		_mecab = mecab_new(argc, argv);
-		mecab_assert(_mecab);
+		argv[argc++] = "-u";
+		argv[argc++] = mecab_userdic;
 	}
+
+	return mecab_model_new(argc, argv);
 }
 
 /*
- * _PG_fini - 뒷 정리
+ * mecab_model_install - 새 모델을 씀
+ * 처음이면 백엔드 분석기를 만들고, 아니면 mecab_model_swap 으로 모델을 바꿈.
+ * 분석기 (tagger) 들은 그대로 쓰고, lattice 는 모델에 딸린 것이라 새로 만든다.
+ * 분석 스레드들은 mecab_parse 안에서만 일하므로 지금은 쉬고 있음
  */
-void
-_PG_fini(void)
+static void
+mecab_model_install(mecab_model_t *model, uint64 generation)
 {
-	if (_mecab != NULL)
+	int			i;
+
+	if (_mecab_model == NULL)
+	{
+		mecab_worker *self = &mecab_workers[0];
+
+		_mecab_model = model;
+		self->tagger = mecab_model_new_tagger(_mecab_model);
+		mecab_assert(self->tagger, mecab_strerror(NULL));
+		self->lattice = mecab_model_new_lattice(_mecab_model);
+		mecab_assert(self->lattice, mecab_strerror(NULL));
+	}
+	else
 	{
-		mecab_destroy(_mecab);
-		_mecab = NULL;
+		mecab_assert(mecab_model_swap(_mecab_model, model),
+					 "could not swap dictionary model");
+		for (i = 0; i <= mecab_nthreads; i++)
+		{
+			mecab_worker *worker = &mecab_workers[i];
+
+			mecab_lattice_destroy(worker->lattice);
+			worker->lattice = mecab_model_new_lattice(_mecab_model);
+			mecab_assert(worker->lattice, mecab_strerror(NULL));
+		}
 	}
+
+	mecab_dict_encoding = -1;
+	model_epoch++;
+	model_stamp = mecab_model_stamp();
+	mecab_model_settings_save(generation);
+	analysis_cache_clear();
 }
 
 /*
- * ts_mecabko_start - 파서 시작 함수
- * mecab_sparse_tonode2 호출
- * 영어 쪽을 위해 prsd_start 도 같이 호출
+ * mecab_model_settings_save - 지금 모델의 설정과 세대를 기억함
  */
-Datum
-ts_mecabko_start(PG_FUNCTION_ARGS)
+static void
+mecab_model_settings_save(uint64 generation)
 {
-	mecab_t			   *mecab = mecab_acquire();
-	char			   *input = (char *) PG_GETARG_POINTER(0);
-	int					len	= PG_GETARG_INT32(1);
-	parser_data	   *parser;
-
-	parser = (parser_data *) palloc(sizeof(parser_data));
-	initStringInfo(&parser->str);
-	/*
-	 * XXX: 한국어 문자열 일반화
-         * 전각 영숫자는 소문자로
-         * 한자는 한글로 (못하면 그대로)
-	 */
-	normalize(&parser->str, input, len, appendString);
-
-	/* Replace input text to the normalized text. */
-	input = parser->str.data;
-	len = parser->str.len;
+	if (model_dicdir != NULL)
+		pfree(model_dicdir);
+	if (model_userdic != NULL)
+		pfree(model_userdic);
+	model_dicdir = MemoryContextStrdup(TopMemoryContext,
+									   mecab_dicdir ? mecab_dicdir : "");
+	model_userdic = MemoryContextStrdup(TopMemoryContext,
+										mecab_userdic ? mecab_userdic : "");
+	model_generation = generation;
+}
 
-	/*
-	 * 파싱
-	 */
-	parser->node = mecab_sparse_tonode2(mecab, input, len);
-	mecab_assert(parser->node);
+/*
+ * mecab_prewarm_file - 파일을 끝까지 읽어서 페이지 캐시에 올려 둠
+ */
+static void
+mecab_prewarm_file(const char *path, void *arg)
+{
+	char		buf[65536];
+	int			fd;
+	ssize_t		nread;
+	int64		total = 0;
 
-	/* 영숫자는 prsd 쪽으로 넘김 */
-	parser->ascprs = DirectFunctionCall2(
-		prsd_start, CStringGetDatum(input), Int32GetDatum(len));
-	parser->last_node_pos = NULL;
+	fd = open(path, O_RDONLY | PG_BINARY, 0);
+	if (fd < 0)
+		return;
+	while ((nread = read(fd, buf, sizeof(buf))) > 0)
+		total += nread;
+	close(fd);
 
-    PG_RETURN_POINTER(parser);
+	elog(DEBUG1, "textsearch_ko: prewarmed \"%s\" (" INT64_FORMAT " bytes)",
+		 path, total);
 }
 
-static const mecab_node_t *
-next_token(parser_data *parser)
+/*
+ * mecab_model_files - 지금 모델의 사전 파일마다 callback 을 부름
+ * 시스템 사전 옆의 matrix.bin, char.bin, unk.dic 도 넣음
+ */
+static void
+mecab_model_files(void (*callback) (const char *path, void *arg), void *arg)
 {
-	const mecab_node_t *result;
+	static const char *const sysfiles[] = { "matrix.bin", "char.bin", "unk.dic" };
+	const mecab_dictionary_info_t *info;
+	int			i;
 
-	for (; parser->node != NULL; parser->node = parser->node->next)
+	for (info = mecab_model_dictionary_info(_mecab_model); info != NULL;
+		 info = info->next)
 	{
-		/* 파서 자료 중 처음과 끝 무시 */
-		switch (parser->node->stat)
+		callback(info->filename, arg);
+
+		if (info->type == MECAB_SYS_DIC)
 		{
-		case MECAB_BOS_NODE:
-		case MECAB_EOS_NODE:
-			continue;
-		}
+			char		dir[MAXPGPATH];
+			char		path[MAXPGPATH];
 
-		result = parser->node;
-		parser->node = parser->node->next;
-		return result;
+			strlcpy(dir, info->filename, sizeof(dir));
+			get_parent_directory(dir);
+			for (i = 0; i < lengthof(sysfiles); i++)
+			{
+				join_path_components(path, dir, sysfiles[i]);
+				callback(path, arg);
+			}
+		}
 	}
+}
 
-	return NULL;	/* 末尾 */
+/*
+ * mecab_model_prewarm - 사전 파일들을 미리 읽음
+ * shared_preload_libraries 로 올리면 postmaster 에서 모델을 만들고, 백엔드들은
+ * fork 로 그 모델 (mmap 한 사전 포함) 을 물려받는다. 사전 파일들을 페이지
+ * 캐시에 올려 두면 백엔드들의 첫 분석이 디스크를 기다리지 않는다.
+ */
+static void
+mecab_model_prewarm(void)
+{
+	mecab_model_files(mecab_prewarm_file, NULL);
 }
 
 /*
- * FIXME: グローバル変数 current_node 経由で処理中の node を渡すのは非常に危険
- * なのだが、他に ts_headline に対応する方法が無いので仕方なくこの方法を取っている.
- * この方式だと、ts_debug() が期待通りに動作しない問題がある.
- * FIXME : 전역 변수 current_node 통해 처리되는 node를 전달하는 것은 매우 위험하지만,
- * 다른 ts_headline에 대응하는 방법이 없기 때문에 어쩔 수없이 이 방법을 취하고있다.
- * 이 방식때문에 ts_debug ()이 예상대로 작동하지 않는 문제가있다. (구글번역)
- * 사전 처리에 문제가 있음 - ioseph
+ * mecab_file_stamp - 파일 경로, 크기, 고친 시각을 *arg 해시에 더함
  */
+static void
+mecab_file_stamp(const char *path, void *arg)
+{
+	uint64	   *stamp = (uint64 *) arg;
+	struct stat st;
 
-static const mecab_node_t *current_node;
+	*stamp = hash_combine64(*stamp,
+							DatumGetUInt64(hash_any_extended((const unsigned char *) path,
+															 strlen(path), 0)));
+	if (stat(path, &st) == 0)
+	{
+		*stamp = hash_combine64(*stamp, (uint64) st.st_size);
+		*stamp = hash_combine64(*stamp, (uint64) st.st_mtime);
+	}
+}
 
-Datum
-ts_mecabko_gettoken(PG_FUNCTION_ARGS)
+/*
+ * mecab_model_stamp - 지금 모델의 사전 파일들로 만든 해시
+ * 공유 사전 세대와 달리 서버를 다시 켜도 파일이 그대로면 같은 값이라
+ * 색인 트리거가 해시에 넣음
+ */
+static uint64
+mecab_model_stamp(void)
 {
-	parser_data	*parser = (parser_data *) PG_GETARG_POINTER(0);
-	const char	**t = (const char **) PG_GETARG_POINTER(1);
-	int		*tlen  = (int *) PG_GETARG_POINTER(2);
-	int		lextype;
-	const char	*skip;
-	const mecab_node_t *node;
-	const char	*conjstr;
-	int		conjlen;
+	uint64		stamp = 0;
 
-	current_node = NULL;
+	mecab_model_files(mecab_file_stamp, &stamp);
+	return stamp;
+}
 
-	if (parser->last_node_pos == NULL)
-	{
-		for (;;)
-		{
-			/* 일단 기본 파서로 노드 형식을 구함 */
-			lextype = DatumGetInt32(DirectFunctionCall3(
-				prsd_nexttoken, parser->ascprs,
-				PointerGetDatum(t), PointerGetDatum(tlen)));
+/*
+ * mecab_model_check - 사전 설정이나 공유 사전 세대가 바뀌었으면 모델을 새로 만듦
+ * 새 사전을 못 읽으면 WARNING 을 내고 설정이 다시 바뀔 때까지 예전 모델을 씀.
+ * 쓰고 있는 예전 모델 분석 결과는 캐시에 남지만 model_epoch 로 가려서 쓰지 않음
+ */
+static void
+mecab_model_check(void)
+{
+	uint64		generation = model_generation;
+	mecab_model_t *model;
 
-			if (lextype == 0)
-			{
-				/* 파싱 완료 */
-				PG_RETURN_INT32(0);
-			}
-			else if (lextype == SPACE && *tlen > 0 && **t == SEPARATOR_CHAR)
-			{
-				/* \v 문자인데, space면 무시 */
-				continue;
-			}
-			else if (IS_MECAB_WORD(lextype))
-			{
-				/* 파싱 작업 대상이 됨 */
-				skip = *t;
-				parser->last_node_pos = *t + *tlen;
-				break;
-			}
-			else
-			{
-				/* 그밖은 그대로 통과 */
-				parser->last_node_pos = NULL;
-				PG_RETURN_INT32(lextype);
-			}
-		}
-	}
-	else
-		skip = NULL;
+	if (dict_shared != NULL)
+		generation = pg_atomic_read_u64(&dict_shared->generation);
 
-	do
-	{
-		node = next_token(parser);
-		if (node == NULL)
-			PG_RETURN_INT32(0);
-	} while (node->surface < skip);
+	if (generation == model_generation &&
+		strcmp(mecab_dicdir ? mecab_dicdir : "", model_dicdir) == 0 &&
+		strcmp(mecab_userdic ? mecab_userdic : "", model_userdic) == 0)
+		return;
 
-	/* 검색에 사용할 품사만 거르고 나머지는 통과 */
-	if ((feature(node, MECAB_CONJTYPE, &conjstr, &conjlen))
-                   && (strncmp(conjstr, "Inflect,", 8) == 0)
-                   && (feature(node, MECAB_DETAIL, &conjstr, &conjlen))){
-		lextype = WORD_T;
+	model = mecab_model_create();
+	if (model == NULL)
+	{
+		ereport(WARNING,
+				(errcode(ERRCODE_EXTERNAL_ROUTINE_EXCEPTION),
+				 errmsg("mecab: could not reload dictionary: %s",
+						mecab_strerror(NULL)),
+				 errdetail("The previously loaded dictionary is still used.")));
+		mecab_model_settings_save(generation);
+		return;
 	}
-	else if (accept_mecab_ko_part(node->feature, strchr(node->feature, ',') - node->feature))
-		lextype = WORD_T;
-	else
-		lextype = SPACE;
 
-	*t = node->surface;
-	*tlen = node->length;
-	if (*t + *tlen >= parser->last_node_pos)
-		parser->last_node_pos = NULL;
-
-	current_node = node;
-
-	PG_RETURN_INT32(lextype);
+	mecab_model_install(model, generation);
 }
 
 /*
- * ts_mecabko_end - 파싱 뒷작업
+ * mecab_worker_main - 분석 스레드
+ * PostgreSQL 함수는 하나도 부르지 않음 (palloc, elog 모두), 오류는 ok 로만 알림
  */
-Datum
-ts_mecabko_end(PG_FUNCTION_ARGS)
+static void *
+mecab_worker_main(void *arg)
 {
-	parser_data *parser = (parser_data *) PG_GETARG_POINTER(0);
+	mecab_worker *worker = (mecab_worker *) arg;
+	int			id = worker - mecab_workers;
+	uint64		seen = 0;
+
+	for (;;)
+	{
+		bool		mine;
 
-	current_node = NULL;
+		pthread_mutex_lock(&pool_mutex);
+		while (pool_generation == seen)
+			pthread_cond_wait(&pool_work, &pool_mutex);
+		seen = pool_generation;
+		mine = (id < pool_njobs);
+		pthread_mutex_unlock(&pool_mutex);
 
-	DirectFunctionCall1(prsd_end, parser->ascprs);
+		if (!mine)
+			continue;
 
-	pfree(parser->str.data);
-	pfree(parser);
+		mecab_lattice_set_sentence2(worker->lattice, worker->input, worker->len);
+		worker->ok = (mecab_parse_lattice(worker->tagger, worker->lattice) != 0);
 
-	PG_RETURN_VOID();
-}
+		pthread_mutex_lock(&pool_mutex);
+		if (--pool_pending == 0)
+			pthread_cond_signal(&pool_done);
+		pthread_mutex_unlock(&pool_mutex);
+	}
 
+	return NULL;
+}
 
 /*
- * ts_mecabko_lexize - 사전처리
- * 현재 ts_lexize 에서 의도된 대로 움직이지 않음
- * to_tsvector 에서만 의도된 대로 됨
- * 위에서 말한 current_node 전역변수 처리 때문
- *
- * 이 함수로 넘어오는 단어는 형태소 분석기가 의미 단위로 분리한 그 단어가 넘어온다.
- * 예를 들어 '가까워졌음을'이 입력되면, {가깝,어,지,었,음,을} 로 분리하거나,
- * 약어, 동의어, 자동수정 등 기능을 할 수 있다.
- * 
- * 현재는 단지 용언 활용 부분만 처리한다.
+ * mecab_pool_start - 분석 스레드를 nthreads 개까지 띄움
+ * 시그널은 모두 막은 채로 띄워서 백엔드 스레드만 시그널을 받게 함
  */
-Datum
-ts_mecabko_lexize(PG_FUNCTION_ARGS)
+static void
+mecab_pool_start(int nthreads)
 {
+	sigset_t	all;
+	sigset_t	old;
 
-	const char *t = (char *) PG_GETARG_POINTER(1);
-	int			tlen = PG_GETARG_INT32(2);
-	TSLexeme   *res;
-	int pluscnt = 0;
-	const char *pluspos;
-	const char *slashpos;
-	int i;
-
-	if (current_node) {
-		if ((feature(current_node, MECAB_CONJTYPE, &t, &tlen))
-		   && (strncmp(t, "Inflect,", 8) == 0)
-		   && (feature(current_node, MECAB_DETAIL, &t, &tlen))){
-			do {
-				pluspos = strchr(t, '+');
-				pluscnt += 1;
-				if(pluspos != NULL) t = pluspos + 1;
-			} while (pluspos != NULL);
-			feature(current_node, MECAB_DETAIL, &t, &tlen);
-			res = palloc0(sizeof(TSLexeme) * (pluscnt + 1));
-			i = 0;
-			do {
-				pluspos = strchr(t, '+');
-				slashpos = strchr(t, '/');
-				/* accept_mecab_ko_part 호출해서 제외 품사면 통과 */
-				if(accept_mecab_ko_part(slashpos + 1, strchr(slashpos + 1, '/') - slashpos - 1)){
-					res[i].lexeme = lexize(t, slashpos - t);
-					i += 1;
-				}
-				if(pluspos != NULL) 
-					t = pluspos + 1;
-			} while (pluspos != NULL);
-		}
-		else {
-			res = palloc0(sizeof(TSLexeme) * 2);
-			feature(current_node, MECAB_BASIC, &t, &tlen);
-			res[0].lexeme = lexize(t, tlen);
+	sigfillset(&all);
+	pthread_sigmask(SIG_SETMASK, &all, &old);
+
+	while (mecab_nthreads < nthreads)
+	{
+		mecab_worker *worker = &mecab_workers[mecab_nthreads + 1];
+
+		if (worker->tagger == NULL)
+			worker->tagger = mecab_model_new_tagger(_mecab_model);
+		if (worker->lattice == NULL)
+			worker->lattice = mecab_model_new_lattice(_mecab_model);
+		if (worker->tagger == NULL || worker->lattice == NULL ||
+			pthread_create(&worker->thread, NULL, mecab_worker_main, worker) != 0)
+		{
+			mecab_pool_failed = true;
+			break;
 		}
-	}
-	else {
-		res = palloc0(sizeof(TSLexeme) * 2);
-		res[0].lexeme = lexize(t,tlen);
+		mecab_nthreads++;
 	}
 
-	PG_RETURN_POINTER(res);
-}
+	pthread_sigmask(SIG_SETMASK, &old, NULL);
 
-#define make_text(s, ln) \
-	PointerGetDatum(cstring_to_text_with_len((s), (ln)))
+	if (mecab_pool_failed)
+		ereport(WARNING,
+				(errmsg("mecab: could not start analysis threads, using %d",
+						mecab_nthreads)));
+}
 
 /*
- * mecabko_analyze - mecab node dump
+ * mecab_parse - input 을 분석해서 조각마다 첫 노드를 firsts 에 담고 조각 수를 돌려줌
+ * textsearch_ko.analysis_threads 가 있고 input 이 textsearch_ko.parallel_threshold
+ * 보다 크면 문장 끝이나 공백에서 나눠 분석 스레드들과 같이 분석한다.
+ * 노드들은 다음 분석 전까지만 쓸 수 있음
  */
-Datum
-mecabko_analyze(PG_FUNCTION_ARGS)
+static int
+mecab_parse(const char *input, int len, const mecab_node_t **firsts)
 {
-	mecab_t		   *mecab = mecab_acquire();
-	FuncCallContext	   *funcctx;
-	List		   *tuples;
-	HeapTuple	tuple;
-	HeapTuple	result;
+	mecab_worker *self = mecab_acquire();
+	int			threshold = analysis_parallel_threshold * 1024;
+	int			njobs = 1;
+	int			start;
+	int			i;
 
-	if (SRF_IS_FIRSTCALL())
+	if (analysis_threads > 0 && len > threshold)
 	{
-		text		   *txt = PG_GETARG_TEXT_PP(0);
-		const mecab_node_t *node;
-		TupleDesc	tupdesc;
-
-		if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
-			elog(ERROR, "return and sql tuple descriptions are incompatible");
+		int			nthreads = Min(analysis_threads, len / threshold);
 
-		node = mecab_sparse_tonode2(mecab,
-				VARDATA_ANY(txt), VARSIZE_ANY_EXHDR(txt));
-		mecab_assert(node);
+		if (mecab_nthreads < nthreads && !mecab_pool_failed)
+			mecab_pool_start(nthreads);
+		njobs = Min(nthreads, mecab_nthreads) + 1;
+	}
 
-		funcctx = SRF_FIRSTCALL_INIT();
+	for (i = 0, start = 0; i < njobs; i++)
+	{
+		int			piece = len - start;
 
-		tuples = NIL;
-		for (; node != NULL; node = node->next)
-		{
-			int		i;
-			Datum		values[NUM_CSV+1];
-			bool		nulls[NUM_CSV+1] = { 0 };
-			const char	   *csv;
-			const char         *conjtype;
-			int                conjlen;
-			const char *pluspos;
-			const char *slashpos;
+		if (i < njobs - 1)
+			piece = chunk_boundary(input + start, piece / (njobs - i));
+		mecab_workers[i].input = input + start;
+		mecab_workers[i].len = piece;
+		start += piece;
+	}
 
-			
+	if (njobs > 1)
+	{
+		pthread_mutex_lock(&pool_mutex);
+		pool_njobs = njobs;
+		pool_pending = njobs - 1;
+		pool_generation++;
+		pthread_cond_broadcast(&pool_work);
+		pthread_mutex_unlock(&pool_mutex);
+	}
+
+	/* 첫 조각은 백엔드가 직접 */
+	mecab_lattice_set_sentence2(self->lattice, self->input, self->len);
+	self->ok = (mecab_parse_lattice(self->tagger, self->lattice) != 0);
+
+	if (njobs > 1)
+	{
+		pthread_mutex_lock(&pool_mutex);
+		while (pool_pending > 0)
+			pthread_cond_wait(&pool_done, &pool_mutex);
+		pthread_mutex_unlock(&pool_mutex);
+	}
+
+	for (i = 0; i < njobs; i++)
+	{
+		mecab_assert(mecab_workers[i].ok,
+					 mecab_lattice_strerror(mecab_workers[i].lattice));
+		firsts[i] = mecab_lattice_get_bos_node(mecab_workers[i].lattice);
+	}
+
+	return njobs;
+}
+
+/*
+ * mecab_next_node - mecab_parse 조각들을 이어서 본 다음 노드
+ * node 가 NULL 이면 처음부터, seg 는 지금 조각 번호 (처음엔 -1)
+ */
+static inline const mecab_node_t *
+mecab_next_node(const mecab_node_t *node, const mecab_node_t **firsts,
+				int nsegs, int *seg)
+{
+	if (node != NULL && node->next != NULL)
+		return node->next;
+	while (++(*seg) < nsegs)
+	{
+		if (firsts[*seg] != NULL)
+			return firsts[*seg];
+	}
+	return NULL;
+}
+
+/*
+ * 분석 통계
+ * 백엔드마다 쌓고, shared_preload_libraries 로 올렸으면 트랜잭션이 끝날 때
+ * 늘어난 만큼 공유 메모리 합계에도 더한다.
+ * 시간은 textsearch_ko.track_timing 이 켜져 있을 때만 잰다 (마이크로초).
+ */
+typedef enum stats_counter
+{
+	STATS_DOCUMENTS,		/* 파서가 받은 문서 */
+	STATS_INPUT_BYTES,		/* 파서가 받은 바이트 */
+	STATS_NORMALIZED_BYTES,	/* normalize 결과 바이트 */
+	STATS_MECAB_NODES,		/* mecab 형태소 */
+	STATS_TOKENS,			/* 파서가 넘긴 낱말 토큰 */
+	STATS_FILTERED,			/* 품사로 거른 형태소, 활용 정보 조각 */
+	STATS_INFLECTS,			/* 활용 정보 조각으로 나눈 용언 */
+	STATS_LEXEMES,			/* korean_stem 이 돌려준 낱말 */
+	STATS_OVER_BUDGET,		/* 분석 예산을 넘은 문서 */
+	STATS_NORMALIZE_TIME,
+	STATS_MECAB_TIME,
+	STATS_LEXIZE_TIME,
+	NUM_STATS
+} stats_counter;
+
+typedef struct stats_shared_state
+{
+	pg_atomic_uint64 counters[NUM_STATS];
+	pg_atomic_uint64 reset_time;	/* TimestampTz */
+} stats_shared_state;
+
+static int64		stats_local[NUM_STATS];		/* 이 백엔드 합계 */
+static int64		stats_flushed[NUM_STATS];	/* 그 가운데 공유 메모리에 더한 만큼 */
+static TimestampTz	stats_local_reset = 0;
+static bool			stats_track_timing = false;	/* GUC */
+static stats_shared_state *stats_shared = NULL;
+
+#if PG_VERSION_NUM >= 150000
+static shmem_request_hook_type prev_shmem_request_hook = NULL;
+#endif
+static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
+
+#define stats_add(c, n)		(stats_local[c] += (n))
+
+#define stats_timer_start(start) \
+	do { \
+		if (stats_track_timing) \
+			INSTR_TIME_SET_CURRENT(start); \
+		else \
+			INSTR_TIME_SET_ZERO(start); \
+	} while (0)
+
+#define stats_timer_stop(c, start) \
+	do { \
+		if (stats_track_timing && !INSTR_TIME_IS_ZERO(start)) \
+		{ \
+			instr_time	stop_; \
+			INSTR_TIME_SET_CURRENT(stop_); \
+			INSTR_TIME_SUBTRACT(stop_, start); \
+			stats_local[c] += INSTR_TIME_GET_MICROSEC(stop_); \
+		} \
+	} while (0)
+
+/*
+ * shared_state_request - 공유 메모리 자리 요청 (통계 합계, 사전 세대)
+ */
+static void
+shared_state_request(void)
+{
+#if PG_VERSION_NUM >= 150000
+	if (prev_shmem_request_hook)
+		prev_shmem_request_hook();
+#endif
+	RequestAddinShmemSpace(MAXALIGN(sizeof(stats_shared_state)));
+	RequestAddinShmemSpace(MAXALIGN(sizeof(dict_shared_state)));
+}
+
+/*
+ * shared_state_startup - 공유 메모리 통계 합계, 사전 세대 만들기, 또는 붙기
+ */
+static void
+shared_state_startup(void)
+{
+	bool		found;
+	int			i;
+
+	if (prev_shmem_startup_hook)
+		prev_shmem_startup_hook();
+
+	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+	stats_shared = ShmemInitStruct("textsearch_ko stats",
+								   sizeof(stats_shared_state), &found);
+	if (!found)
+	{
+		for (i = 0; i < NUM_STATS; i++)
+			pg_atomic_init_u64(&stats_shared->counters[i], 0);
+		pg_atomic_init_u64(&stats_shared->reset_time,
+						   (uint64) GetCurrentTimestamp());
+	}
+	dict_shared = ShmemInitStruct("textsearch_ko dictionary",
+								  sizeof(dict_shared_state), &found);
+	if (!found)
+		pg_atomic_init_u64(&dict_shared->generation, 0);
+	LWLockRelease(AddinShmemInitLock);
+}
+
+/*
+ * stats_flush - 지난번 뒤로 늘어난 만큼 공유 메모리 합계에 더함
+ */
+static void
+stats_flush(void)
+{
+	int			i;
+
+	if (stats_shared == NULL)
+		return;
+
+	for (i = 0; i < NUM_STATS; i++)
+	{
+		if (stats_local[i] != stats_flushed[i])
+		{
+			pg_atomic_fetch_add_u64(&stats_shared->counters[i],
+									(uint64) (stats_local[i] - stats_flushed[i]));
+			stats_flushed[i] = stats_local[i];
+		}
+	}
+}
+
+/*
+ * 분석 결과 캐시
+ * 같은 문장을 한 쿼리 안에서 여러번 분석하는 경우가 많아서 (GIN recheck,
+ * ts_headline 등) 백엔드마다 분석 결과를 LRU 방식으로 보관한다.
+ * 키는 분석 문자열의 해시값과 길이이고, 그래도 충돌하면 문자열을 비교해서 새로 분석한다.
+ */
+typedef struct analysis_key
+{
+	uint32		hash;
+	int32		len;
+} analysis_key;
+
+typedef struct analysis_entry
+{
+	analysis_key	key;		/* 키 */
+	mecab_result   *result;
+} analysis_entry;
+
+static int			analysis_cache_size = 1024;	/* GUC, kB 단위 */
+static int			analysis_chunk_size = 1024;	/* GUC, kB 단위, 0 이면 안 나눔 */
+static int			analysis_segment_size = 256;	/* GUC, kB 단위, 0 이면 안 나눔 */
+static int			analysis_time_budget = 0;	/* GUC, 밀리초, 0 이면 제한 없음 */
+static int			analysis_size_budget = 0;	/* GUC, kB 단위, 0 이면 제한 없음 */
+static MemoryContext analysis_cache_cxt = NULL;
+static HTAB		   *analysis_cache = NULL;
+static dlist_head	analysis_lru = DLIST_STATIC_INIT(analysis_lru);
+static Size			analysis_cache_used = 0;
+static int64		analysis_cache_hits = 0;
+static int64		analysis_cache_misses = 0;
+
+/*
+ * 파서가 조각마다 쓰는 normalize 결과, 토큰 버퍼
+ * 문서를 많이 분석할 때 (korean_to_tsvector, 대량 색인) 매번 할당하지 않도록
+ * 백엔드에 하나씩 두고 다시 쓴다. PARSER_BUFFER_KEEP 보다 커지면 버림
+ */
+#define PARSER_BUFFER_KEEP	(256 * 1024)
+
+static MemoryContext parser_buffer_cxt = NULL;
+static StringInfoData parser_text;
+static token_buf	parser_tokens;
+
+static void
+analysis_cache_init(void)
+{
+	HASHCTL		ctl;
+
+	analysis_cache_cxt = AllocSetContextCreate(TopMemoryContext,
+											   "textsearch_ko analysis cache",
+											   ALLOCSET_DEFAULT_SIZES);
+
+	MemSet(&ctl, 0, sizeof(ctl));
+	ctl.keysize = sizeof(analysis_key);
+	ctl.entrysize = sizeof(analysis_entry);
+	ctl.hcxt = analysis_cache_cxt;
+	analysis_cache = hash_create("textsearch_ko analysis cache", 256, &ctl,
+								 HASH_ELEM | HASH_BLOBS | HASH_CONTEXT);
+}
+
+/*
+ * parser_buffer_reset - 파서 버퍼들을 비움, 처음이면 만듦
+ */
+static void
+parser_buffer_reset(void)
+{
+	if (parser_buffer_cxt == NULL)
+	{
+		MemoryContext oldcontext;
+
+		parser_buffer_cxt = AllocSetContextCreate(TopMemoryContext,
+												  "textsearch_ko parser buffers",
+												  ALLOCSET_DEFAULT_SIZES);
+		oldcontext = MemoryContextSwitchTo(parser_buffer_cxt);
+		initStringInfo(&parser_text);
+		parser_tokens.maxtokens = 64;
+		parser_tokens.tokens = (parser_token *)
+			palloc(sizeof(parser_token) * parser_tokens.maxtokens);
+		MemoryContextSwitchTo(oldcontext);
+	}
+
+	resetStringInfo(&parser_text);
+	parser_tokens.ntokens = 0;
+}
+
+/*
+ * parser_buffer_trim - 큰 문서 때문에 커진 파서 버퍼를 줄임
+ */
+static void
+parser_buffer_trim(void)
+{
+	if (parser_text.maxlen > PARSER_BUFFER_KEEP)
+	{
+		pfree(parser_text.data);
+		parser_text.data = MemoryContextAlloc(parser_buffer_cxt, 1024);
+		parser_text.maxlen = 1024;
+		resetStringInfo(&parser_text);
+	}
+	if (sizeof(parser_token) * parser_tokens.maxtokens > PARSER_BUFFER_KEEP)
+	{
+		pfree(parser_tokens.tokens);
+		parser_tokens.maxtokens = 64;
+		parser_tokens.tokens = (parser_token *)
+			MemoryContextAlloc(parser_buffer_cxt,
+							   sizeof(parser_token) * parser_tokens.maxtokens);
+	}
+}
+
+/*
+ * analysis_cache_remove - 캐시에서 빼고 메모리 반환
+ */
+static void
+analysis_cache_remove(mecab_result *result)
+{
+	analysis_key key;
+
+	key.hash = result->hash;
+	key.len = result->textlen;
+	hash_search(analysis_cache, &key, HASH_REMOVE, NULL);
+	dlist_delete(&result->lru);
+	analysis_cache_used -= result->size;
+	if (result->tokens)
+		pfree(result->tokens);
+	pfree(result);
+}
+
+/*
+ * analysis_cache_shrink - 예산을 넘지 않을 때까지 오래된 것부터 뺀다
+ * 사용 중인 결과는 건너뛴다.
+ */
+static void
+analysis_cache_shrink(Size limit)
+{
+	dlist_node *cur = analysis_lru.head.prev;
+
+	while (cur != &analysis_lru.head && analysis_cache_used > limit)
+	{
+		mecab_result *result = dlist_container(mecab_result, lru, cur);
+
+		cur = cur->prev;
+		if (result->refcount == 0)
+			analysis_cache_remove(result);
+	}
+}
+
+/*
+ * analysis_cache_clear - 사용 중이 아닌 결과를 모두 뺀다
+ */
+static void
+analysis_cache_clear(void)
+{
+	if (analysis_cache != NULL)
+		analysis_cache_shrink(0);
+}
+
+/*
+ * analysis_xact_callback - 트랜잭션이 끝나면 모든 결과는 사용 중이 아님
+ * 오류로 빠져나가 analysis_release 를 못한 결과도 이때 풀린다. 파서들은
+ * 메모리 컨텍스트가 없어질 때 parser_cleanup 이 목록에서 뺀다.
+ * 통계도 이때 공유 메모리 합계에 더한다.
+ */
+static void
+analysis_xact_callback(XactEvent event, void *arg)
+{
+	dlist_iter	iter;
+
+	if (event != XACT_EVENT_COMMIT && event != XACT_EVENT_ABORT &&
+		event != XACT_EVENT_PARALLEL_COMMIT &&
+		event != XACT_EVENT_PARALLEL_ABORT)
+		return;
+
+	dlist_foreach(iter, &analysis_lru)
+		dlist_container(mecab_result, lru, iter.cur)->refcount = 0;
+
+	last_parse.doc = NULL;
+	parse_target = &last_parse;
+
+	stats_flush();
+}
+
+/*
+ * mecab 없이 나눈 낱말 (ANALYSIS_CHEAP 어절, ANALYSIS_BIGRAM 두 글자) 의
+ * feature, 일반 명사로 본다. 품사 말고 값이 없으므로 기본형은 표면형 그대로
+ */
+static const char cheap_feature[] = "NNG";
+
+/*
+ * analysis_node_add - analysis_node 배열에 하나 추가, 모자라면 늘림
+ */
+static inline void
+analysis_node_add(analysis_node **nodes, int *maxnodes, int *nnodes,
+				  int offset, int length, int feature)
+{
+	analysis_node *node;
+
+	if (*nnodes >= *maxnodes)
+	{
+		*maxnodes *= 2;
+		*nodes = (analysis_node *) repalloc(*nodes,
+											sizeof(analysis_node) * *maxnodes);
+	}
+
+	node = &(*nodes)[(*nnodes)++];
+	node->offset = offset;
+	node->length = length;
+	node->feature = feature;
+}
+
+/*
+ * analysis_build - mecab 로 분석하고 그 결과를 한 덩어리로 복사
+ * limit 보다 작으면 캐시 메모리에, 아니면 지금 메모리 컨텍스트에 만든다.
+ *
+ * ANALYSIS_NATIVE 이면 멀티바이트 문자 구간들만 공백으로 이어 붙여서
+ * 분석한다. 영숫자, URL 같은 것들은 mecab 이 볼 필요가 없다.
+ * ANALYSIS_CHEAP 이면 그 구간들을 mecab 에 넘기지 않고 하나씩 형태소로 두고,
+ * ANALYSIS_BIGRAM 이면 구간 안 글자마다 그 글자부터 두 글자씩 형태소로 둔다.
+ *
+ * mecab 은 한번 부르면 끝날 때까지 취소를 받지 못하므로, 입력을
+ * textsearch_ko.segment_size 단위로 나눠 분석하고 그 사이마다 인터럽트를
+ * 확인한다. 단위마다 노드는 다음 분석 때 사라지므로 analysis_node 로
+ * 옮겨 두었다가 마지막에 한 덩어리로 복사한다.
+ */
+static mecab_result *
+analysis_build(const char *str, int len, int mode, uint32 hash, Size limit)
+{
+	const mecab_node_t *node;
+	const mecab_node_t *firsts[MAX_ANALYSIS_THREADS + 1];
+	int					nsegs;
+	int					seg;
+	mecab_result	   *result;
+	int					nmorphs = 0;
+	int					maxnodes = 64;
+	int					maxpieces = 0;
+	int					segment;
+	int					done;
+	int					segnodes pg_attribute_unused();	/* USE_SDT 일 때만 씀 */
+	Size				size;
+	Size				morphsize;
+	char			   *p;
+	mecab_morph		   *m;
+	mecab_piece		   *pieces;
+	analysis_node	   *nodes;
+	StringInfoData		features;
+	const char		   *input = str;
+	int					inputlen = len;
+	StringInfoData		spans;
+	int				   *span_src = NULL;	/* 구간의 str 안 위치 */
+	int				   *span_dst = NULL;	/* 구간의 input 안 위치 */
+	int					nspans = 0;
+	int					span = 0;
+	int					i;
+	instr_time			start;
+
+	if (mode != ANALYSIS_FULL)
+	{
+		const char *end = str + len;
+		const char *q;
+		int			maxspans = 16;
+
+		initStringInfo(&spans);
+		span_src = (int *) palloc(sizeof(int) * maxspans);
+		span_dst = (int *) palloc(sizeof(int) * maxspans);
+
+		for (q = str; q < end; )
+		{
+			const char *s;
+
+			if (!IS_HIGHBIT_SET(*q))
+			{
+				q = ascii_run_end(q, end);
+				continue;
+			}
+
+			for (s = q; q < end && IS_HIGHBIT_SET(*q); q++)
+				;
+
+			if (nspans >= maxspans)
+			{
+				maxspans *= 2;
+				span_src = (int *) repalloc(span_src, sizeof(int) * maxspans);
+				span_dst = (int *) repalloc(span_dst, sizeof(int) * maxspans);
+			}
+			span_src[nspans] = s - str;
+			span_dst[nspans] = spans.len;
+			nspans++;
+
+			appendBinaryStringInfo(&spans, s, q - s);
+			appendStringInfoChar(&spans, ' ');
+		}
+
+		input = spans.data;
+		inputlen = spans.len;
+	}
+
+	initStringInfo(&features);
+
+	nodes = (analysis_node *) palloc(sizeof(analysis_node) * maxnodes);
+
+	if (!ANALYSIS_USES_MECAB(mode))
+	{
+		/* feature 는 모두 같은 것 하나를 씀 */
+		appendBinaryStringInfo(&features, cheap_feature, sizeof(cheap_feature));
+		for (i = 0; i < nspans; i++)
+		{
+			int			pos = span_dst[i];
+			int			end = (i + 1 < nspans ? span_dst[i + 1] : inputlen) - 1;
+
+			if (mode == ANALYSIS_CHEAP)
+			{
+				analysis_node_add(&nodes, &maxnodes, &nmorphs, pos, end - pos, 0);
+				continue;
+			}
+
+			/* 마지막 글자는 한 글자로, 한 글자 검색어가 앞부분 일치로 찾게 함 */
+			while (pos < end)
+			{
+				int			len1 = Min(uchar_mblen(input + pos), end - pos);
+				int			len2 = 0;
+
+				if (pos + len1 < end)
+					len2 = Min(uchar_mblen(input + pos + len1), end - pos - len1);
+				analysis_node_add(&nodes, &maxnodes, &nmorphs, pos, len1 + len2, 0);
+				pos += len1;
+			}
+		}
+		inputlen = 0;
+	}
+
+	/*
+	 * 분석 스레드들이 나눠 분석하면 스레드마다 segment_size 씩
+	 * 분석할 것이 없으면 mecab 을 부르지 않음
+	 */
+	segment = analysis_segment_size * 1024;
+	if (analysis_threads > 0)
+		segment *= analysis_threads + 1;
+
+	for (done = 0; done < inputlen; done += seg)
+	{
+		seg = inputlen - done;
+		if (segment > 0 && seg > segment)
+			seg = chunk_boundary(input + done, segment);
+
+		CHECK_FOR_INTERRUPTS();
+
+		TRACE_TEXTSEARCH_KO_MECAB_START(seg);
+		stats_timer_start(start);
+		nsegs = mecab_parse(input + done, seg, firsts);
+		stats_timer_stop(STATS_MECAB_TIME, start);
+
+		segnodes = nmorphs;
+		i = -1;
+		for (node = mecab_next_node(NULL, firsts, nsegs, &i); node != NULL;
+			 node = mecab_next_node(node, firsts, nsegs, &i))
+		{
+			const char *c;
+
+			switch (node->stat)
+			{
+			case MECAB_BOS_NODE:
+			case MECAB_EOS_NODE:
+				continue;
+			}
+
+			/* mecab 은 입력 문자열을 복사하지 않으므로 surface 는 input 안을 가리킴 */
+			analysis_node_add(&nodes, &maxnodes, &nmorphs,
+							  node->surface - input, node->length, features.len);
+
+			/* 활용 정보 조각 갯수는 + 갯수보다 많을 수 없음 */
+			maxpieces++;
+			for (c = node->feature; *c; c++)
+			{
+				if (*c == '+')
+					maxpieces++;
+			}
+			appendBinaryStringInfo(&features, node->feature, c - node->feature + 1);
+		}
+		TRACE_TEXTSEARCH_KO_MECAB_DONE(seg, nmorphs - segnodes);
+	}
+
+	CHECK_FOR_INTERRUPTS();
+
+	morphsize = MAXALIGN(offsetof(mecab_result, morphs) +
+						 nmorphs * sizeof(mecab_morph)) +
+		MAXALIGN(maxpieces * sizeof(mecab_piece));
+	size = morphsize + len + 1 + features.len;
+
+	result = (mecab_result *) MemoryContextAlloc(size <= limit ?
+												 analysis_cache_cxt :
+												 CurrentMemoryContext,
+												 size);
+	result->hash = hash;
+	result->mode = mode;
+	result->refcount = 1;
+	result->cached = (size <= limit);
+	result->epoch = model_epoch;
+	result->size = size;
+	result->nmorphs = nmorphs;
+	result->textlen = len;
+	if (ANALYSIS_USES_MECAB(mode))
+		stats_add(STATS_MECAB_NODES, nmorphs);
+	result->tokens = NULL;
+	result->ntokens = 0;
+
+	pieces = (mecab_piece *) ((char *) result +
+							  MAXALIGN(offsetof(mecab_result, morphs) +
+									   nmorphs * sizeof(mecab_morph)));
+	p = (char *) result + morphsize;
+	result->text = p;
+	memcpy(p, str, len);
+	p[len] = '\0';
+	p += len + 1;
+	memcpy(p, features.data, features.len);
+
+	m = result->morphs;
+	for (i = 0; i < nmorphs; i++, m++)
+	{
+		m->offset = nodes[i].offset;
+		if (mode != ANALYSIS_FULL)
+		{
+			/* 형태소는 구간을 넘지 않음, 구간 안 위치를 str 위치로 바꿈 */
+			while (span + 1 < nspans && span_dst[span + 1] <= m->offset)
+				span++;
+			m->offset = span_src[span] + (m->offset - span_dst[span]);
+		}
+		m->length = nodes[i].length;
+		m->feature = p + nodes[i].feature;
+		pieces += morph_parse(m, pieces);
+	}
+
+	pfree(nodes);
+	pfree(features.data);
+	if (mode != ANALYSIS_FULL)
+	{
+		pfree(spans.data);
+		pfree(span_src);
+		pfree(span_dst);
+	}
+
+	return result;
+}
+
+/*
+ * analysis_acquire - 분석 결과를 구함, 캐시에 있으면 그것을 씀
+ * 다 쓰고 나면 analysis_release 호출해야 함
+ */
+static mecab_result *
+analysis_acquire(const char *str, int len, int mode)
+{
+	Size			limit = (Size) analysis_cache_size * 1024;
+	uint32			hash;
+	analysis_key	key;
+	analysis_entry *entry;
+	bool			found;
+	mecab_result   *result;
+
+	/* mecab 을 부르지 않는 방식은 다시 만드는 것이 캐시보다 쌈 */
+	if (!ANALYSIS_USES_MECAB(mode))
+		return analysis_build(str, len, mode, 0, 0);
+
+	mecab_model_check();
+
+	if (limit == 0)
+	{
+		/* 캐시 안 씀, 지금 메모리 컨텍스트에서 분석 */
+		if (analysis_cache != NULL)
+			analysis_cache_shrink(0);
+		return analysis_build(str, len, mode, 0, 0);
+	}
+
+	if (analysis_cache == NULL)
+		analysis_cache_init();
+
+	hash = hash_combine(DatumGetUInt32(hash_any((const unsigned char *) str, len)),
+						(uint32) mode);
+	key.hash = hash;
+	key.len = len;
+	entry = (analysis_entry *) hash_search(analysis_cache, &key,
+										   HASH_FIND, NULL);
+	if (entry != NULL)
+	{
+		result = entry->result;
+		if (result->mode == mode && result->epoch == model_epoch &&
+			memcmp(result->text, str, len) == 0)
+		{
+			analysis_cache_hits++;
+			dlist_move_head(&analysis_lru, &result->lru);
+			result->refcount++;
+			return result;
+		}
+
+		analysis_cache_misses++;
+
+		/* 해시 충돌이나 예전 모델 결과, 사용 중이면 이번 결과는 캐시하지 않음 */
+		if (result->refcount > 0)
+			return analysis_build(str, len, mode, hash, 0);
+		analysis_cache_remove(result);
+	}
+	else
+		analysis_cache_misses++;
+
+	/* 예산보다 크면 캐시하지 않음 */
+	result = analysis_build(str, len, mode, hash, limit);
+	if (!result->cached)
+		return result;
+
+	analysis_cache_shrink(limit - result->size);
+
+	entry = (analysis_entry *) hash_search(analysis_cache, &key,
+										   HASH_ENTER, &found);
+	entry->result = result;
+	dlist_push_head(&analysis_lru, &result->lru);
+	analysis_cache_used += result->size;
+
+	return result;
+}
+
+/*
+ * analysis_release - 분석 결과 사용 끝
+ */
+static void
+analysis_release(mecab_result *result)
+{
+	if (result->refcount > 0)
+		result->refcount--;
+	if (!result->cached && result->refcount == 0)
+	{
+		if (result->tokens)
+			pfree(result->tokens);
+		pfree(result);
+	}
+}
+
+/*
+ * _PG_init - 동적 모듈 초기화
+ */
+void
+_PG_init(void)
+{
+	DefineCustomStringVariable("textsearch_ko.dicdir",
+							   "Sets the mecab system dictionary directory.",
+							   "Empty uses the dicdir of mecabrc.",
+							   &mecab_dicdir,
+							   "",
+							   PGC_SIGHUP,
+							   0,
+							   NULL, NULL, NULL);
+
+	DefineCustomStringVariable("textsearch_ko.userdic",
+							   "Sets the mecab user dictionaries, separated by commas.",
+							   "Backends load the new dictionaries on their next analysis "
+							   "after a configuration reload or textsearch_ko_reload_dictionary().",
+							   &mecab_userdic,
+							   "",
+							   PGC_SIGHUP,
+							   0,
+							   NULL, NULL, NULL);
+
+	DefineCustomBoolVariable("textsearch_ko.prewarm",
+							 "Reads the mecab dictionary files into the page cache at server start.",
+							 "Only used when loaded via shared_preload_libraries.",
+							 &mecab_prewarm,
+							 true,
+							 PGC_POSTMASTER,
+							 0,
+							 NULL, NULL, NULL);
+
+	/*
+	 * shared_preload_libraries 로 올렸으면 postmaster 에서 한번만 만들고
+	 * 백엔드들은 fork 로 물려받음 (copy-on-write). 사전 인코딩과 DB 인코딩
+	 * 비교는 백엔드마다 처음 분석할 때 (mecab_acquire) 함
+	 * 병렬 작업자도 리더가 읽은 라이브러리를 다시 읽으면서 여기서 자기 모델을
+	 * 가지므로, 프로세스끼리 나누는 것은 공유 메모리 통계 합계와 사전 세대뿐
+	 */
+	if (_mecab_model == NULL)
+	{
+		mecab_model_t *model = mecab_model_create();
+
+		mecab_assert(model, mecab_strerror(NULL));
+		mecab_model_install(model, 0);
+
+		if (process_shared_preload_libraries_in_progress && mecab_prewarm)
+			mecab_model_prewarm();
+	}
+
+	DefineCustomIntVariable("textsearch_ko.cache_size",
+							"Sets the memory used to cache morphological analysis results.",
+							"Zero disables the cache.",
+							&analysis_cache_size,
+							1024, 0, MAX_KILOBYTES,
+							PGC_USERSET,
+							GUC_UNIT_KB,
+							NULL, NULL, NULL);
+
+	DefineCustomIntVariable("textsearch_ko.chunk_size",
+							"Sets the size of the pieces large documents are analyzed in.",
+							"Documents are split at a sentence or whitespace boundary. "
+							"Zero analyzes the whole document at once.",
+							&analysis_chunk_size,
+							1024, 0, MAX_KILOBYTES,
+							PGC_SUSET,
+							GUC_UNIT_KB,
+							NULL, NULL, NULL);
+
+	DefineCustomIntVariable("textsearch_ko.segment_size",
+							"Sets the most text mecab analyzes in one call.",
+							"Analysis can be canceled between calls. With analysis_threads "
+							"each thread analyzes this much. Zero analyzes a chunk in one call.",
+							&analysis_segment_size,
+							256, 0, MAX_KILOBYTES,
+							PGC_SUSET,
+							GUC_UNIT_KB,
+							NULL, NULL, NULL);
+
+	DefineCustomIntVariable("textsearch_ko.analysis_time_budget",
+							"Sets the analysis time one document may use.",
+							"Checked between segments, so a document can run over by one segment. "
+							"The rest of the document is split into words without mecab. "
+							"Zero disables the limit.",
+							&analysis_time_budget,
+							0, 0, INT_MAX,
+							PGC_SUSET,
+							GUC_UNIT_MS,
+							NULL, NULL, NULL);
+
+	DefineCustomIntVariable("textsearch_ko.analysis_size_budget",
+							"Sets the text size of one document that is analyzed by mecab.",
+							"Checked between segments, so a document can run over by one segment. "
+							"The rest of the document is split into words without mecab. "
+							"Zero disables the limit.",
+							&analysis_size_budget,
+							0, 0, MAX_KILOBYTES,
+							PGC_SUSET,
+							GUC_UNIT_KB,
+							NULL, NULL, NULL);
+
+	DefineCustomIntVariable("textsearch_ko.analysis_threads",
+							"Sets the number of threads that analyze one large document together.",
+							"Zero analyzes every document in the backend alone.",
+							&analysis_threads,
+							0, 0, MAX_ANALYSIS_THREADS,
+							PGC_SUSET,
+							0,
+							NULL, NULL, NULL);
+
+	DefineCustomIntVariable("textsearch_ko.parallel_threshold",
+							"Sets the text size each analysis thread gets at least.",
+							NULL,
+							&analysis_parallel_threshold,
+							256, 1, MAX_KILOBYTES,
+							PGC_SUSET,
+							GUC_UNIT_KB,
+							NULL, NULL, NULL);
+
+	DefineCustomEnumVariable("textsearch_ko.tokenizer",
+							 "Selects how the korean parser splits text.",
+							 "native sends only multibyte runs to mecab and other runs to the default parser, "
+							 "prsd runs both over the whole text.",
+							 &parser_tokenizer,
+							 ANALYSIS_NATIVE,
+							 tokenizer_options,
+							 PGC_SUSET,
+							 0,
+							 NULL, NULL, NULL);
+
+	DefineCustomBoolVariable("textsearch_ko.track_timing",
+							 "Collects timing statistics for normalization, mecab analysis and lexize.",
+							 "Shown by textsearch_ko_stats().",
+							 &stats_track_timing,
+							 false,
+							 PGC_SUSET,
+							 0,
+							 NULL, NULL, NULL);
+
+	DefineCustomBoolVariable("textsearch_ko.hanja_to_hangul",
+							 "Converts Hanja to their Hangul reading before analysis.",
+							 NULL,
+							 &normalize_hanja,
+							 false,
+							 PGC_SUSET,
+							 0,
+							 NULL, NULL, NULL);
+
+#if PG_VERSION_NUM >= 150000
+	MarkGUCPrefixReserved("textsearch_ko");
+#else
+	EmitWarningsOnPlaceholders("textsearch_ko");
+#endif
+
+	RegisterXactCallback(analysis_xact_callback, NULL);
+
+	/* shared_preload_libraries 로 올렸으면 모든 백엔드 통계 합계와 사전 세대를 둠 */
+	if (process_shared_preload_libraries_in_progress)
+	{
+#if PG_VERSION_NUM >= 150000
+		prev_shmem_request_hook = shmem_request_hook;
+		shmem_request_hook = shared_state_request;
+#else
+		shared_state_request();
+#endif
+		prev_shmem_startup_hook = shmem_startup_hook;
+		shmem_startup_hook = shared_state_startup;
+	}
+
+	pos_hash_init();
+	normalize_init();
+	default_accept_pos = pos_set_parse(accept_parts_of_speech);
+	default_dict.accept_pos = default_accept_pos;
+	jamo_pos = pos_set_parse(jamo_parts_of_speech);
+	default_dict.min_length = 1;
+}
+
+/*
+ * _PG_fini - 뒷 정리
+ */
+void
+_PG_fini(void)
+{
+	/* 분석 스레드가 있으면 모델을 쓰고 있으므로 그대로 둠 */
+	if (_mecab_model != NULL && mecab_nthreads == 0)
+	{
+		mecab_lattice_destroy(mecab_workers[0].lattice);
+		mecab_destroy(mecab_workers[0].tagger);
+		mecab_model_destroy(_mecab_model);
+		mecab_workers[0].lattice = NULL;
+		mecab_workers[0].tagger = NULL;
+		_mecab_model = NULL;
+	}
+}
+
+/*
+ * ts_mecabko_start - 파서 시작 함수
+ * 분석 결과를 구하고 (mecab_parse), 넘겨줄 토큰들을 한꺼번에 만든다.
+ * 영어 쪽을 위해 prsd 파서도 같이 씀
+ */
+Datum
+ts_mecabko_start(PG_FUNCTION_ARGS)
+{
+	PG_RETURN_POINTER(parser_start((char *) PG_GETARG_POINTER(0),
+								   PG_GETARG_INT32(1), parser_tokenizer));
+}
+
+/*
+ * ts_mecabko_bigram_start - korean_bigram 파서 시작 함수
+ * mecab 을 부르지 않고 멀티바이트 구간을 두 글자씩 나눔, 나머지는 korean 파서와 같음
+ */
+Datum
+ts_mecabko_bigram_start(PG_FUNCTION_ARGS)
+{
+	PG_RETURN_POINTER(parser_start((char *) PG_GETARG_POINTER(0),
+								   PG_GETARG_INT32(1), ANALYSIS_BIGRAM));
+}
+
+/*
+ * parser_start - 파싱 시작, mode 는 ANALYSIS_*
+ * 파서는 지금 메모리 컨텍스트 아래 제 컨텍스트에 만든다. ts_mecabko_end 를
+ * 부르기 전에 (서브) 트랜잭션이 오류로 끝나서 컨텍스트가 없어져도
+ * parser_cleanup 이 파싱 중인 파서 목록에서 빼고 분석 결과를 놓아 준다.
+ */
+static parser_data *
+parser_start(const char *input, int len, int mode)
+{
+	MemoryContext	cxt;
+	parser_data	   *parser;
+
+	TRACE_TEXTSEARCH_KO_PARSE_START(len, mode);
+
+	cxt = AllocSetContextCreate(CurrentMemoryContext,
+								"textsearch_ko parser",
+								ALLOCSET_SMALL_SIZES);
+	parser = (parser_data *) MemoryContextAlloc(cxt, sizeof(parser_data));
+	parser->cxt = cxt;
+	parser->input = input;
+	parser->inputlen = len;
+	parser->result = NULL;
+	parser->prev = NULL;
+	parser->doc = parser->input;
+	parser->doclen = parser->inputlen;
+	parser->ntokens = 0;
+	parser->mode = mode;
+	parser->analyzed = 0;
+	INSTR_TIME_SET_ZERO(parser->elapsed);
+	parser->record = parse_target;
+	parser->record->doc = NULL;
+
+	stats_add(STATS_DOCUMENTS, 1);
+	stats_add(STATS_INPUT_BYTES, parser->inputlen);
+
+	dlist_push_head(&active_parsers, &parser->node);
+	parser->cleanup.func = parser_cleanup;
+	parser->cleanup.arg = parser;
+	MemoryContextRegisterResetCallback(cxt, &parser->cleanup);
+
+	/* 입력이 크면 조각씩, 나머지는 토큰을 다 넘겨준 뒤에 분석 */
+	parser_next_chunk(parser);
+
+	TRACE_TEXTSEARCH_KO_PARSE_START_DONE(len, parser->result->ntokens);
+
+	return parser;
+}
+
+/*
+ * parser_next_chunk - 입력의 다음 조각을 분석해서 토큰을 만듦
+ * 사전 처리가 앞 조각 토큰을 늦게 볼 수도 있어서 (thesaurus 등)
+ * 앞 조각 분석 결과 하나는 남겨 둔다.
+ */
+static bool
+parser_next_chunk(parser_data *parser)
+{
+	int				len;
+	int				mode;
+	instr_time		start;
+	instr_time		stop;
+	MemoryContext	oldcontext;
+
+	if (parser->result != NULL && parser->inputlen == 0)
+		return false;
+
+	if (ANALYSIS_USES_MECAB(parser->mode) && parser_over_budget(parser))
+	{
+		parser->mode = ANALYSIS_CHEAP;
+		stats_add(STATS_OVER_BUDGET, 1);
+		ereport(DEBUG1,
+				(errmsg("mecab: document exceeds the analysis budget"),
+				 errdetail("The remaining %d bytes of the document are split into words without morphological analysis.",
+						   parser->inputlen)));
+	}
+	mode = parser->mode;
+
+	INSTR_TIME_SET_CURRENT(start);
+
+	len = parser_chunk_length(parser->input, parser->inputlen);
+
+	parser_buffer_reset();
+	/*
+	 * XXX: 한국어 문자열 일반화
+         * 전각 영숫자는 소문자로
+         * 한자는 한글로 (textsearch_ko.hanja_to_hangul, 표에 없으면 그대로)
+	 */
+	normalize(&parser_text, parser->input, len, NULL);
+	parser->input += len;
+	parser->inputlen -= len;
+
+	if (parser->prev != NULL)
+		analysis_release(parser->prev);
+	parser->prev = parser->result;
+	parser->result = NULL;
+
+	/*
+	 * 파싱, 같은 문자열을 분석한 적이 있으면 그 결과를 씀
+	 * 캐시하지 않는 결과는 파서 컨텍스트에 만듦
+	 */
+	oldcontext = MemoryContextSwitchTo(parser->cxt);
+	parser->result = analysis_acquire(parser_text.data, parser_text.len, mode);
+	parser->next = 0;
+
+	if (parser->result->tokens == NULL)
+		analysis_tokenize(parser->result);
+	MemoryContextSwitchTo(oldcontext);
+	parser_buffer_trim();
+
+	if (ANALYSIS_USES_MECAB(mode))
+	{
+		INSTR_TIME_SET_CURRENT(stop);
+		INSTR_TIME_ACCUM_DIFF(parser->elapsed, stop, start);
+		parser->analyzed += len;
+	}
+
+	return true;
+}
+
+/*
+ * parser_over_budget - 문서 분석 예산을 넘었는가
+ * textsearch_ko.analysis_time_budget, analysis_size_budget 은 조각마다
+ * 확인하므로 조각 하나 (예산이 있으면 segment_size 까지) 만큼 넘을 수 있다.
+ */
+static bool
+parser_over_budget(const parser_data *parser)
+{
+	if (analysis_size_budget > 0 &&
+		parser->analyzed >= (int64) analysis_size_budget * 1024)
+		return true;
+	if (analysis_time_budget > 0 &&
+		INSTR_TIME_GET_MILLISEC(parser->elapsed) >= analysis_time_budget)
+		return true;
+	return false;
+}
+
+/*
+ * parser_chunk_length - 파서가 이번에 분석할 조각 길이
+ * 분석 예산이 있으면 조각마다 예산을 확인하도록 분석 단위보다 크게 자르지 않음
+ */
+static int
+parser_chunk_length(const char *s, int len)
+{
+	int			chunk = analysis_chunk_size * 1024;
+
+	if ((analysis_time_budget > 0 || analysis_size_budget > 0) &&
+		analysis_segment_size > 0 &&
+		(chunk == 0 || chunk > analysis_segment_size * 1024))
+		chunk = analysis_segment_size * 1024;
+
+	if (chunk > 0 && len > chunk)
+		return chunk_boundary(s, chunk);
+	return len;
+}
+
+/*
+ * token_add - 토큰 버퍼에 토큰 하나 추가
+ */
+static inline void
+token_add(token_buf *buf, int type, int offset, int length,
+		  const mecab_morph *morph)
+{
+	parser_token *token;
+
+	if (buf->ntokens >= buf->maxtokens)
+	{
+		buf->maxtokens *= 2;
+		buf->tokens = (parser_token *) repalloc(buf->tokens,
+												sizeof(parser_token) * buf->maxtokens);
+	}
+
+	token = &buf->tokens[buf->ntokens++];
+	token->type = type;
+	token->offset = offset;
+	token->length = length;
+	token->morph = morph;
+}
+
+/*
+ * token_add_morph - 형태소 토큰 추가
+ * 검색에 사용할 품사만 거르고 나머지는 통과
+ */
+static inline void
+token_add_morph(token_buf *buf, const mecab_morph *node)
+{
+	int			type;
+
+	if (morph_is_inflect(node))
+		type = WORD_T;
+	else if (default_accept_pos & POS_BIT(node->pos))
+		type = WORD_T;
+	else
+		type = SPACE;
+
+	token_add(buf, type, node->offset, node->length, node);
+}
+
+/*
+ * tokenize_prsd - prsd 파서로 노드 형식을 구하고, 단어들은 그 범위의
+ * 형태소들로 나눈다. 형태소가 없는 구간이면 morphs 는 NULL
+ * next 는 다음에 볼 morphs 위치
+ */
+static void
+tokenize_prsd(token_buf *buf, const char *text, int start, int len,
+			  const mecab_morph *morphs, int nmorphs, int *next)
+{
+	Datum		ascprs;
+	char	   *t;
+	int			tlen;
+	int			lextype;
+	bool		exhausted = false;
+
+	/* 영숫자는 prsd 쪽으로 넘김 */
+	ascprs = DirectFunctionCall2(prsd_start,
+								 CStringGetDatum(text + start),
+								 Int32GetDatum(len));
+
+	while (!exhausted)
+	{
+		const mecab_morph *node;
+		const char *wordend;
+
+		/* 일단 기본 파서로 노드 형식을 구함 */
+		lextype = DatumGetInt32(DirectFunctionCall3(
+			prsd_nexttoken, ascprs,
+			PointerGetDatum(&t), PointerGetDatum(&tlen)));
+
+		if (lextype == 0)
+		{
+			/* 파싱 완료 */
+			break;
+		}
+		else if (lextype == SPACE && tlen > 0 && *t == SEPARATOR_CHAR)
+		{
+			/* \v 문자인데, space면 무시 */
+			continue;
+		}
+		else if (morphs == NULL || !IS_MECAB_WORD(lextype))
+		{
+			/* 그밖은 그대로 통과 */
+			token_add(buf, lextype, t - text, tlen, NULL);
+			continue;
+		}
+
+		/* 파싱 작업 대상이 됨, 단어 범위의 형태소들로 나눔 */
+		while (*next < nmorphs && morphs[*next].offset < t - text)
+			(*next)++;
+		wordend = t + tlen;
+
+		do
+		{
+			if (*next >= nmorphs)
+			{
+				exhausted = true;
+				break;
+			}
+			node = &morphs[(*next)++];
+			token_add_morph(buf, node);
+		} while (text + node->offset + node->length < wordend);
+	}
+
+	DirectFunctionCall1(prsd_end, ascprs);
+}
+
+/*
+ * tokenize_native - 멀티바이트 구간은 형태소들로, 나머지 구간만 prsd 로
+ * 공백뿐인 구간은 prsd 를 부르지 않고 공백 토큰 하나로 넘긴다.
+ */
+static void
+tokenize_native(token_buf *buf, const mecab_result *result)
+{
+	const char *text = result->text;
+	const char *end = text + result->textlen;
+	const char *p;
+	const char *q;
+	int			next = 0;
+
+	for (p = text; p < end; p = q)
+	{
+		if (IS_HIGHBIT_SET(*p))
+		{
+			for (q = p; q < end && IS_HIGHBIT_SET(*q); q++)
+				;
+			while (next < result->nmorphs &&
+				   text + result->morphs[next].offset < q)
+				token_add_morph(buf, &result->morphs[next++]);
+		}
+		else
+		{
+			bool		blank = true;
+
+			for (q = p; q < end && !IS_HIGHBIT_SET(*q); q++)
+			{
+				if (!isspace((unsigned char) *q))
+					blank = false;
+			}
+
+			if (!blank)
+				tokenize_prsd(buf, text, p - text, q - p, NULL, 0, NULL);
+			else if (*p != SEPARATOR_CHAR)
+				token_add(buf, SPACE, p - text, q - p, NULL);
+		}
+	}
+}
+
+/*
+ * analysis_tokenize - 분석 결과로 파서가 넘겨줄 토큰 배열을 만듦
+ * 토큰 배열도 분석 결과와 같이 캐시된다.
+ * 토큰은 parser_tokens 버퍼에 모았다가 옮기므로 parser_buffer_reset 뒤에 부름
+ */
+static void
+analysis_tokenize(mecab_result *result)
+{
+	token_buf  *buf = &parser_tokens;
+	Size		size;
+
+	if (result->mode != ANALYSIS_FULL)
+		tokenize_native(buf, result);
+	else
+	{
+		int			next = 0;
+
+		tokenize_prsd(buf, result->text, 0, result->textlen,
+					  result->morphs, result->nmorphs, &next);
+	}
+
+	/* 분석 결과와 같은 메모리 컨텍스트로 옮김 */
+	size = sizeof(parser_token) * buf->ntokens;
+	result->tokens = (parser_token *)
+		MemoryContextAlloc(GetMemoryChunkContext(result), Max(size, 1));
+	memcpy(result->tokens, buf->tokens, size);
+	result->ntokens = buf->ntokens;
+	result->size += size;
+	if (result->cached)
+		analysis_cache_used += size;
+}
+
+/*
+ * ts_mecabko_gettoken - 만들어 둔 토큰을 하나씩 넘겨줌
+ */
+Datum
+ts_mecabko_gettoken(PG_FUNCTION_ARGS)
+{
+	parser_data	*parser = (parser_data *) PG_GETARG_POINTER(0);
+	const char	**t = (const char **) PG_GETARG_POINTER(1);
+	int		*tlen  = (int *) PG_GETARG_POINTER(2);
+	const parser_token *token;
+
+	while (parser->next >= parser->result->ntokens)
+	{
+		if (!parser_next_chunk(parser))
+			PG_RETURN_INT32(0);	/* 파싱 완료 */
+	}
+
+	token = &parser->result->tokens[parser->next++];
+	*t = parser->result->text + token->offset;
+	*tlen = token->length;
+	parser->ntokens++;
+
+	TRACE_TEXTSEARCH_KO_TOKEN(token->type, token->length);
+
+	if (token->type != SPACE)
+		stats_add(STATS_TOKENS, 1);
+	else if (token->morph != NULL)
+		stats_add(STATS_FILTERED, 1);
+
+	PG_RETURN_INT32(token->type);
+}
+
+/*
+ * ts_mecabko_end - 파싱 뒷작업
+ */
+Datum
+ts_mecabko_end(PG_FUNCTION_ARGS)
+{
+	parser_data *parser = (parser_data *) PG_GETARG_POINTER(0);
+
+	TRACE_TEXTSEARCH_KO_PARSE_DONE(parser->doclen, parser->ntokens);
+
+	parser->record->doc = parser->doc;
+	parser->record->doclen = parser->doclen;
+	parser->record->ntokens = parser->ntokens;
+
+	/* parser_cleanup 이 정리 */
+	MemoryContextDelete(parser->cxt);
+
+	PG_RETURN_VOID();
+}
+
+/*
+ * parser_cleanup - 파서 컨텍스트가 없어질 때 파서를 목록에서 빼고
+ * 분석 결과를 놓아 줌
+ */
+static void
+parser_cleanup(void *arg)
+{
+	parser_data *parser = (parser_data *) arg;
+
+	dlist_delete(&parser->node);
+
+	if (parser->prev != NULL)
+		analysis_release(parser->prev);
+	if (parser->result != NULL)
+		analysis_release(parser->result);
+}
+
+/*
+ * result_lookup_morph - 분석 결과의 토큰 가운데 t 위치 토큰의 형태소
+ * hint 는 먼저 볼 토큰 위치 (보통은 바로 앞에 넘겨준 토큰), 없으면 -1
+ */
+static bool
+result_lookup_morph(const mecab_result *result, int hint,
+					const char *t, int tlen, const mecab_morph **morph)
+{
+	const parser_token *token;
+	int			offset;
+	int			lo;
+	int			hi;
+
+	if (result == NULL ||
+		t < result->text || t >= result->text + result->textlen)
+		return false;
+	offset = t - result->text;
+
+	if (hint >= 0 && hint < result->ntokens)
+	{
+		token = &result->tokens[hint];
+		if (token->offset == offset && token->length == tlen)
+		{
+			*morph = token->morph;
+			return true;
+		}
+	}
+
+	lo = 0;
+	hi = result->ntokens - 1;
+	while (lo <= hi)
+	{
+		int			mid = lo + (hi - lo) / 2;
+
+		token = &result->tokens[mid];
+		if (token->offset < offset)
+			lo = mid + 1;
+		else if (token->offset > offset)
+			hi = mid - 1;
+		else
+		{
+			*morph = (token->length == tlen ? token->morph : NULL);
+			return true;
+		}
+	}
+
+	*morph = NULL;
+	return true;
+}
+
+/*
+ * parser_lookup_morph - 파싱 중인 토큰이면 그 형태소를 찾음
+ * 사전 처리 함수는 파서가 넘겨준 토큰 포인터를 그대로 받으므로, 파싱 중인
+ * 분석 문자열 안을 가리키면 위치로 형태소를 찾을 수 있다.
+ * ts_headline 처럼 파싱과 사전 처리가 번갈아 불리지 않아도 된다.
+ * 조각으로 나눠 분석 중이면 지금 조각과 앞 조각을 본다.
+ */
+static const mecab_morph *
+parser_lookup_morph(const char *t, int tlen)
+{
+	dlist_iter	iter;
+
+	dlist_foreach(iter, &active_parsers)
+	{
+		parser_data *parser = dlist_container(parser_data, node, iter.cur);
+		const mecab_morph *morph;
+
+		if (result_lookup_morph(parser->result, parser->next - 1,
+								t, tlen, &morph) ||
+			result_lookup_morph(parser->prev, -1, t, tlen, &morph))
+			return morph;
+	}
+
+	return NULL;
+}
+
+/*
+ * 헤드라인
+ * prsd_headline 대신 파서가 넘긴 낱말들을 어절 (띄어쓰기 단위) 로 묶어서
+ * 한번 훑으며 조각을 고른다. 조각은 검색어가 있는 어절에서 시작해서
+ * MaxWords 를 넘지 않을 만큼 어절을 이어 붙이고, 어절 중간에서 자르지 않는다.
+ * 낱말들은 정리된 (normalize) 문자열 조각이므로 원문 조각으로 되돌린다.
+ */
+#define HEADLINE_CHUNK_SIZE		8192	/* korean_headline 이 한번에 파싱할 크기 */
+
+#define HL_REPLACE(t)	((t) == TAG_T)
+#define HL_SKIP(t)		((t) == URL_T || (t) == NUMHWORD || (t) == ASCIIHWORD || (t) == HWORD)
+#define HL_NONWORD(t)	((t) == SPACE || HL_REPLACE(t) || HL_SKIP(t))
+
+#if PG_VERSION_NUM < 120000
+#define pg_strtoint32(s)	pg_atoi((s), sizeof(int32), 0)
+#endif
+
+/*
+ * headline_options - ts_headline 옵션 읽기
+ * ShortWord 는 받기만 함, 어절 경계로 자르므로 짧은 낱말을 따로 보지 않음
+ */
+static void
+headline_options(HeadlineParsedText *prs, List *prsoptions, headline_opts *opts)
+{
+	ListCell   *l;
+	int			shortword = 3;
+
+	opts->max_words = 35;
+	opts->min_words = 15;
+	opts->max_fragments = 0;
+	opts->highlight_all = false;
+	prs->startsel = NULL;
+	prs->stopsel = NULL;
+	prs->fragdelim = NULL;
+
+	foreach(l, prsoptions)
+	{
+		DefElem    *defel = (DefElem *) lfirst(l);
+		char	   *val = defGetString(defel);
+
+		if (pg_strcasecmp(defel->defname, "MaxWords") == 0)
+			opts->max_words = pg_strtoint32(val);
+		else if (pg_strcasecmp(defel->defname, "MinWords") == 0)
+			opts->min_words = pg_strtoint32(val);
+		else if (pg_strcasecmp(defel->defname, "ShortWord") == 0)
+			shortword = pg_strtoint32(val);
+		else if (pg_strcasecmp(defel->defname, "MaxFragments") == 0)
+			opts->max_fragments = pg_strtoint32(val);
+		else if (pg_strcasecmp(defel->defname, "StartSel") == 0)
+			prs->startsel = pstrdup(val);
+		else if (pg_strcasecmp(defel->defname, "StopSel") == 0)
+			prs->stopsel = pstrdup(val);
+		else if (pg_strcasecmp(defel->defname, "FragmentDelimiter") == 0)
+			prs->fragdelim = pstrdup(val);
+		else if (pg_strcasecmp(defel->defname, "HighlightAll") == 0)
+			opts->highlight_all = (pg_strcasecmp(val, "1") == 0 ||
+								   pg_strcasecmp(val, "on") == 0 ||
+								   pg_strcasecmp(val, "true") == 0 ||
+								   pg_strcasecmp(val, "t") == 0 ||
+								   pg_strcasecmp(val, "y") == 0 ||
+								   pg_strcasecmp(val, "yes") == 0);
+		else
+			ereport(ERROR,
+					(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+					 errmsg("unrecognized headline parameter: \"%s\"",
+							defel->defname)));
+	}
+
+	if (!opts->highlight_all)
+	{
+		if (opts->min_words >= opts->max_words)
+			ereport(ERROR,
+					(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+					 errmsg("MinWords should be less than MaxWords")));
+		if (opts->min_words <= 0)
+			ereport(ERROR,
+					(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+					 errmsg("MinWords should be positive")));
+		if (shortword < 0)
+			ereport(ERROR,
+					(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+					 errmsg("ShortWord should be >= 0")));
+		if (opts->max_fragments < 0)
+			ereport(ERROR,
+					(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+					 errmsg("MaxFragments should be >= 0")));
+	}
+
+	if (!prs->startsel)
+		prs->startsel = pstrdup("<b>");
+	if (!prs->stopsel)
+		prs->stopsel = pstrdup("</b>");
+	if (!prs->fragdelim)
+		prs->fragdelim = pstrdup(" ... ");
+	prs->startsellen = strlen(prs->startsel);
+	prs->stopsellen = strlen(prs->stopsel);
+	prs->fragdelimlen = strlen(prs->fragdelim);
+}
+
+/*
+ * headline_locate - first 부터의 낱말들이 원문 doc 의 어디인지 찾음
+ * 파서와 같은 조각으로 나눠 다시 normalize 하면서 위치 기록을 얻고,
+ * 낱말들을 이어 붙인 것이 정리된 문자열과 같은지 확인한다.
+ * 같으면 낱말마다 원문 위치, 길이를 starts, lengths 에 적고 참
+ */
+static bool
+headline_locate(const HeadlineParsedText *prs, int first,
+				const char *doc, int doclen, int *starts, int *lengths)
+{
+	int			done = 0;
+	int			i = first;
+	bool		matched = true;
+
+	while (matched && done < doclen)
+	{
+		int				len = parser_chunk_length(doc + done, doclen - done);
+		StringInfoData	str;
+		offset_map		map;
+		int				pos = 0;
+
+		initStringInfo(&str);
+		offset_map_init(&map);
+		normalize(&str, doc + done, len, &map);
+
+		for (; i < prs->curwords && pos < str.len; i++)
+		{
+			HeadlineWordEntry *word = &prs->words[i];
+			int			start;
+
+			if (word->repeated)
+				continue;
+			if (pos + word->len > str.len ||
+				memcmp(str.data + pos, word->word, word->len) != 0)
+			{
+				matched = false;
+				break;
+			}
+
+			start = offset_map_lookup(&map, pos);
+			starts[i - first] = done + start;
+			lengths[i - first] = offset_map_lookup(&map, pos + word->len) - start;
+
+			/* 하이픈 낱말, URL 은 뒤에 오는 부분 낱말들과 겹침 */
+			if (!HL_SKIP(word->type))
+				pos += word->len;
+		}
+		if (pos != str.len)
+			matched = false;
+
+		pfree(str.data);
+		pfree(map.dst);
+		pfree(map.src);
+		done += len;
+	}
+	for (; matched && i < prs->curwords; i++)
+	{
+		if (!prs->words[i].repeated)
+			matched = false;
+	}
+
+	return matched;
+}
+
+/*
+ * headline_restore - first 부터의 낱말들을 원문 조각으로 바꿈
+ * 방금 끝난 파싱 (parsed) 이 이 낱말들을 만들었고 headline_locate 로
+ * 원문 위치를 모두 찾았을 때만 바꾼다. 아니면 아무것도 바꾸지 않음
+ */
+static void
+headline_restore(HeadlineParsedText *prs, int first, parse_record *parsed)
+{
+	const char *doc = parsed->doc;
+	int			doclen = parsed->doclen;
+	int			nwords = 0;
+	int		   *starts;
+	int		   *lengths;
+	int			i;
+
+	parsed->doc = NULL;
+	if (doc == NULL)
+		return;
+
+	for (i = first; i < prs->curwords; i++)
+	{
+		if (!prs->words[i].repeated)
+			nwords++;
+	}
+	if (nwords != parsed->ntokens)
+		return;
+
+	starts = (int *) palloc(sizeof(int) * (prs->curwords - first + 1));
+	lengths = (int *) palloc(sizeof(int) * (prs->curwords - first + 1));
+
+	if (headline_locate(prs, first, doc, doclen, starts, lengths))
+	{
+		for (i = first; i < prs->curwords; i++)
+		{
+			HeadlineWordEntry *word = &prs->words[i];
+
+			/* 같은 낱말의 다른 검색어 항목은 앞 낱말을 따라감 */
+			if (word->repeated)
+			{
+				word->word = prs->words[i - 1].word;
+				word->len = prs->words[i - 1].len;
+				continue;
+			}
+			pfree(word->word);
+			word->word = pnstrdup(doc + starts[i - first], lengths[i - first]);
+			word->len = lengths[i - first];
+		}
+	}
+
+	pfree(starts);
+	pfree(lengths);
+}
+
+/*
+ * headline_is_break - 어절 사이 낱말, 공백이 들어 있는 비단어
+ */
+static inline bool
+headline_is_break(const HeadlineWordEntry *word)
+{
+	int			i;
+
+	if (word->type != SPACE && !HL_REPLACE(word->type))
+		return false;
+	for (i = 0; i < word->len; i++)
+	{
+		if (isspace((unsigned char) word->word[i]))
+			return true;
+	}
+	return false;
+}
+
+/*
+ * headline_mark - from ~ to 낱말들을 헤드라인에 넣음
+ */
+static void
+headline_mark(HeadlineParsedText *prs, const headline_opts *opts,
+			  int from, int to)
+{
+	int			i;
+
+	for (i = from; i <= to; i++)
+	{
+		HeadlineWordEntry *word = &prs->words[i];
+
+		if (word->item)
+			word->selected = 1;
+		if (!opts->highlight_all && HL_REPLACE(word->type))
+			word->replace = 1;
+		else if (HL_SKIP(word->type))
+			word->skip = 1;
+		word->in = (word->repeated) ? 0 : 1;
+	}
+}
+
+/*
+ * headline_close - 열린 조각을 닫음
+ * 바로 뒤 낱말이 어절에 붙은 문장 부호로 시작하면 (". ") 그 부호까지 넣음
+ * 뒤 공백은 조각이 다 정해진 뒤 headline_trim 에서 떼어냄
+ */
+static void
+headline_close(HeadlineParsedText *prs, const headline_opts *opts,
+			   headline_state *st)
+{
+	int			last = st->frag_last;
+
+	if (last + 1 < prs->curwords)
+	{
+		HeadlineWordEntry *word = &prs->words[last + 1];
+
+		if (headline_is_break(word) && !isspace((unsigned char) word->word[0]))
+			last++;
+	}
+
+	headline_mark(prs, opts, st->frag, last);
+	st->frag = -1;
+	st->nfrags++;
+	if (st->nfrags >= Max(opts->max_fragments, 1))
+		st->done = true;
+}
+
+/*
+ * headline_eojeol_end - 어절 하나가 끝남 (마지막 낱말 last)
+ * 열린 조각에 이어 붙이거나, 넘치면 조각을 닫고, 검색어가 있으면 새 조각
+ */
+static void
+headline_eojeol_end(HeadlineParsedText *prs, const headline_opts *opts,
+					headline_state *st, int last)
+{
+	if (st->eojeol < 0)
+		return;
+
+	if (st->frag >= 0)
+	{
+		if (st->frag_words + st->eojeol_words > opts->max_words &&
+			st->frag_words >= opts->min_words)
+			headline_close(prs, opts, st);
+		else
+		{
+			st->frag_last = last;
+			st->frag_words += st->eojeol_words;
+		}
+	}
+
+	if (!st->done && st->frag < 0 && st->eojeol_match)
+	{
+		st->frag = st->eojeol;
+		st->frag_last = last;
+		st->frag_words = st->eojeol_words;
+	}
+
+	st->eojeol = -1;
+	st->eojeol_words = 0;
+	st->eojeol_match = false;
+}
+
+/*
+ * headline_init - 조각 고르기 시작
+ */
+static void
+headline_init(headline_state *st)
+{
+	st->next = 0;
+	st->eojeol = -1;
+	st->eojeol_words = 0;
+	st->eojeol_match = false;
+	st->frag = -1;
+	st->frag_last = -1;
+	st->frag_words = 0;
+	st->nfrags = 0;
+	st->done = false;
+}
+
+/*
+ * headline_scan - 아직 안 본 낱말들을 훑음
+ * 조각을 다 찾으면 (MaxFragments, 없으면 하나) st->done
+ */
+static void
+headline_scan(HeadlineParsedText *prs, const headline_opts *opts,
+			  headline_state *st)
+{
+	if (opts->highlight_all)
+		return;
+
+	for (; st->next < prs->curwords && !st->done; st->next++)
+	{
+		HeadlineWordEntry *word = &prs->words[st->next];
+
+		if (word->repeated)
+			continue;
+
+		if (headline_is_break(word))
+		{
+			headline_eojeol_end(prs, opts, st, st->next - 1);
+			continue;
+		}
+
+		if (st->eojeol < 0)
+			st->eojeol = st->next;
+		if (!HL_NONWORD(word->type))
+			st->eojeol_words++;
+		if (word->item)
+			st->eojeol_match = true;
+
+		/* 띄어쓰기 없는 긴 글은 MaxWords 에서 끊음 */
+		if (st->eojeol_words >= opts->max_words)
+			headline_eojeol_end(prs, opts, st, st->next);
+	}
+}
+
+/*
+ * headline_trim - 조각 끝 낱말의 뒤 공백 떼기
+ * 바로 다음 조각이 이어지는 곳은 그대로 둠
+ */
+static void
+headline_trim(HeadlineParsedText *prs)
+{
+	int			i;
+
+	for (i = 0; i < prs->curwords; i++)
+	{
+		HeadlineWordEntry *word = &prs->words[i];
+		int			next;
+		int			len;
+
+		if (!word->in || !headline_is_break(word))
+			continue;
+
+		for (next = i + 1; next < prs->curwords; next++)
+		{
+			if (!prs->words[next].repeated)
+				break;
+		}
+		if (next < prs->curwords && prs->words[next].in)
+			continue;
+
+		len = 0;
+		while (len < word->len && !isspace((unsigned char) word->word[len]))
+			len++;
+		word->len = len;
+	}
+}
+
+/*
+ * headline_finish - 남은 조각 닫기
+ * 검색어가 하나도 없으면 앞에서부터 MinWords 단어를 어절 단위로
+ */
+static void
+headline_finish(HeadlineParsedText *prs, const headline_opts *opts,
+				headline_state *st)
+{
+	int			words = 0;
+	int			last = -1;
+	int			i;
+
+	if (opts->highlight_all)
+	{
+		if (prs->curwords > 0)
+			headline_mark(prs, opts, 0, prs->curwords - 1);
+		return;
+	}
+
+	if (!st->done)
+	{
+		headline_eojeol_end(prs, opts, st, prs->curwords - 1);
+		if (st->frag >= 0)
+			headline_close(prs, opts, st);
+	}
+	if (st->nfrags > 0)
+	{
+		headline_trim(prs);
+		return;
+	}
+
+	for (i = 0; i < prs->curwords; i++)
+	{
+		HeadlineWordEntry *word = &prs->words[i];
+
+		if (headline_is_break(word))
+		{
+			if (words >= opts->min_words)
+				break;
+			continue;
+		}
+		if (!HL_NONWORD(word->type))
+			words++;
+		last = i;
+		if (words >= opts->max_words)
+			break;
+	}
+	if (last >= 0)
+	{
+		st->frag = 0;
+		st->frag_last = last;
+		headline_close(prs, opts, st);
+		headline_trim(prs);
+	}
+}
+
+/*
+ * ts_mecabko_headline - korean 파서의 헤드라인 함수
+ * ts_headline 이 문서 전체를 파싱한 낱말들로 조각을 고른다.
+ * 세번째 인자 (tsquery) 는 쓰지 않음, 낱말마다 찾은 검색어로 충분함
+ */
+Datum
+ts_mecabko_headline(PG_FUNCTION_ARGS)
+{
+	HeadlineParsedText *prs = (HeadlineParsedText *) PG_GETARG_POINTER(0);
+	List	   *prsoptions = (List *) PG_GETARG_POINTER(1);
+	headline_opts opts;
+	headline_state st;
+
+	headline_options(prs, prsoptions, &opts);
+	headline_restore(prs, 0, &last_parse);
+
+	headline_init(&st);
+	headline_scan(prs, &opts, &st);
+	headline_finish(prs, &opts, &st);
+
+	PG_RETURN_POINTER(prs);
+}
+
+/*
+ * headline_generate - 고른 낱말들로 헤드라인 문자열 만들기
+ * PostgreSQL 의 generateHeadline 과 같은 모양
+ */
+static text *
+headline_generate(HeadlineParsedText *prs)
+{
+	StringInfoData	str;
+	bool			infrag = false;
+	int				nfrags = 0;
+	int				i;
+
+	initStringInfo(&str);
+	for (i = 0; i < prs->curwords; i++)
+	{
+		HeadlineWordEntry *word = &prs->words[i];
+
+		if (word->repeated)
+			continue;
+		if (!word->in)
+		{
+			infrag = false;
+			continue;
+		}
+
+		if (!infrag)
+		{
+			infrag = true;
+			if (++nfrags > 1)
+				appendBinaryStringInfo(&str, prs->fragdelim, prs->fragdelimlen);
+		}
+
+		if (word->replace)
+			appendStringInfoChar(&str, ' ');
+		else if (!word->skip)
+		{
+			if (word->selected)
+				appendBinaryStringInfo(&str, prs->startsel, prs->startsellen);
+			appendBinaryStringInfo(&str, word->word, word->len);
+			if (word->selected)
+				appendBinaryStringInfo(&str, prs->stopsel, prs->stopsellen);
+		}
+	}
+
+	return cstring_to_text_with_len(str.data, str.len);
+}
+
+/*
+ * korean_headline_byid - ts_headline 처럼 헤드라인을 만들되, 문서를 앞에서부터
+ * 조금씩 파싱하다가 조각을 다 찾으면 나머지는 분석하지 않음
+ * 압축 안 된 toast 값이면 읽는 것도 거기서 멈춤
+ *
+ * 조각은 chunk_reader 가 chunk_boundary 로 문장 끝 (없으면 공백) 에서 자르므로
+ * 어절이 두 조각으로 나뉘지 않고, 조각 고르기 상태 (st) 와 낱말들 (prs) 은
+ * 조각을 넘어 이어지므로 경계 앞뒤 어절이 한 헤드라인 조각에 들어갈 수 있다.
+ * 조각마다의 파싱 기록은 전역 last_parse 가 아니라 여기 parsed 에 받는다.
+ */
+Datum
+korean_headline_byid(PG_FUNCTION_ARGS)
+{
+	Oid			cfgId = PG_GETARG_OID(0);
+	Datum		doc = PG_GETARG_DATUM(1);
+	TSQuery		query = PG_GETARG_TSQUERY(2);
+	List	   *prsoptions = NIL;
+	HeadlineParsedText prs;
+	headline_opts opts;
+	headline_state st;
+	chunk_reader reader;
+	parse_record parsed;
+	const char *chunk;
+	int			chunklen;
+
+	if (PG_NARGS() > 3)
+		prsoptions = deserialize_deflist(PG_GETARG_DATUM(3));
+
+	memset(&prs, 0, sizeof(prs));
+	prs.lenwords = 32;
+	prs.words = (HeadlineWordEntry *) palloc(sizeof(HeadlineWordEntry) * prs.lenwords);
+
+	headline_options(&prs, prsoptions, &opts);
+	headline_init(&st);
+
+	chunk_reader_init(&reader, doc);
+	reader.chunk = HEADLINE_CHUNK_SIZE;
+	while (!st.done && chunk_reader_next(&reader, &chunk, &chunklen))
+	{
+		int			first = prs.curwords;
+		parse_record *saved = parse_target;
+
+		/* 다른 파서면 되돌릴 것이 없음 */
+		parsed.doc = NULL;
+		parse_target = &parsed;
+		PG_TRY();
+		{
+			hlparsetext(cfgId, &prs, query, (char *) chunk, chunklen);
+		}
+		PG_CATCH();
+		{
+			parse_target = saved;
+			PG_RE_THROW();
+		}
+		PG_END_TRY();
+		parse_target = saved;
+
+		if (parsed.doc != chunk || parsed.doclen != chunklen)
+			parsed.doc = NULL;
+		headline_restore(&prs, first, &parsed);
+		headline_scan(&prs, &opts, &st);
+	}
+	chunk_reader_end(&reader, doc);
+
+	headline_finish(&prs, &opts, &st);
+
+	PG_RETURN_TEXT_P(headline_generate(&prs));
+}
+
+/*
+ * korean_headline - 기본 검색 설정으로 korean_headline_byid
+ */
+Datum
+korean_headline(PG_FUNCTION_ARGS)
+{
+	if (PG_NARGS() > 2)
+		PG_RETURN_DATUM(DirectFunctionCall4(korean_headline_byid,
+											ObjectIdGetDatum(getTSCurrentConfig(true)),
+											PG_GETARG_DATUM(0),
+											PG_GETARG_DATUM(1),
+											PG_GETARG_DATUM(2)));
+	PG_RETURN_DATUM(DirectFunctionCall3(korean_headline_byid,
+										ObjectIdGetDatum(getTSCurrentConfig(true)),
+										PG_GETARG_DATUM(0),
+										PG_GETARG_DATUM(1)));
+}
+
+/*
+ * korean_to_tsvector_byid - 문서 배열을 tsvector 배열로, 대량 색인용
+ * 문서마다 to_tsvector 를 부르지만 문서마다 쓴 메모리는 바로 버리고,
+ * mecab lattice, 파서 버퍼들은 다시 쓰므로 SQL 함수 호출을 문서마다
+ * 하는 것보다 싸다. NULL 원소는 NULL 로, 배열 모양은 그대로
+ */
+Datum
+korean_to_tsvector_byid(PG_FUNCTION_ARGS)
+{
+	Oid				cfgId = PG_GETARG_OID(0);
+	ArrayType	   *docs = PG_GETARG_ARRAYTYPE_P(1);
+	Datum		   *values;
+	bool		   *nulls;
+	int				ndocs;
+	int				i;
+	MemoryContext	doccontext;
+	MemoryContext	oldcontext;
+	ArrayType	   *result;
+
+	deconstruct_array(docs, TEXTOID, -1, false, 'i', &values, &nulls, &ndocs);
+
+	doccontext = AllocSetContextCreate(CurrentMemoryContext,
+									   "korean_to_tsvector document",
+									   ALLOCSET_DEFAULT_SIZES);
+
+	for (i = 0; i < ndocs; i++)
+	{
+		TSVector	vector;
+
+		if (nulls[i])
+			continue;
+
+		oldcontext = MemoryContextSwitchTo(doccontext);
+		vector = DatumGetTSVector(DirectFunctionCall2(to_tsvector_byid,
+													  ObjectIdGetDatum(cfgId),
+													  values[i]));
+		MemoryContextSwitchTo(oldcontext);
+
+		values[i] = PointerGetDatum(palloc(VARSIZE(vector)));
+		memcpy(DatumGetPointer(values[i]), vector, VARSIZE(vector));
+		MemoryContextReset(doccontext);
+
+		CHECK_FOR_INTERRUPTS();
+	}
+
+	MemoryContextDelete(doccontext);
+
+	result = construct_md_array(values, nulls, ARR_NDIM(docs), ARR_DIMS(docs),
+								ARR_LBOUND(docs), TSVECTOROID, -1, false, 'i');
+
+	PG_RETURN_ARRAYTYPE_P(result);
+}
+
+/*
+ * korean_to_tsvector - 기본 검색 설정으로 korean_to_tsvector_byid
+ */
+Datum
+korean_to_tsvector(PG_FUNCTION_ARGS)
+{
+	PG_RETURN_DATUM(DirectFunctionCall2(korean_to_tsvector_byid,
+										ObjectIdGetDatum(getTSCurrentConfig(true)),
+										PG_GETARG_DATUM(0)));
+}
+
+/*
+ * korean_tsvector_update_trigger - tsvector_update_trigger 처럼 tsvector 열을
+ * 채우되, 원문 열들의 해시를 int8 열에 적어 두고 UPDATE 에서 해시가 같으면
+ * 분석하지 않고 그대로 둔다.
+ * 인자: tsvector 열, 해시 열, 검색 설정, 원문 열 [:가중치], ...
+ *   korean_tsvector_update_trigger(tsv, tsv_hash, 'korean', 'title:A', body)
+ * 가중치가 있으면 setweight(to_tsvector(열), 가중치) 들을 || 로 잇는 것과 같다.
+ * mecab 사전 파일이 바뀌어 다시 읽었거나 사전 설정이 바뀌면 해시도 바뀌지만
+ * ALTER TEXT SEARCH CONFIGURATION / DICTIONARY 는 알 수 없으므로 tsvector 열을
+ * NULL 로 바꿔서 다시 분석해야 한다.
+ */
+Datum
+korean_tsvector_update_trigger(PG_FUNCTION_ARGS)
+{
+	TriggerData *trigdata;
+	Trigger    *trigger;
+	Relation	rel;
+	HeapTuple	rettuple;
+	int			tsvcol;
+	int			hashcol;
+	Oid			cfgId;
+	int			ntexts;
+	int		   *textcols;
+	char	   *weights;
+	uint64		hash;
+	Datum		vector = (Datum) 0;
+	bool		isnull;
+	int			cols[2];
+	Datum		values[2];
+	bool		nulls[2] = { false, false };
+	int			i;
+
+	if (!CALLED_AS_TRIGGER(fcinfo))
+		elog(ERROR, "korean_tsvector_update_trigger: not fired by trigger manager");
+
+	trigdata = (TriggerData *) fcinfo->context;
+	if (!TRIGGER_FIRED_FOR_ROW(trigdata->tg_event))
+		elog(ERROR, "korean_tsvector_update_trigger: must be fired for row");
+	if (!TRIGGER_FIRED_BEFORE(trigdata->tg_event))
+		elog(ERROR, "korean_tsvector_update_trigger: must be fired BEFORE event");
+
+	if (TRIGGER_FIRED_BY_INSERT(trigdata->tg_event))
+		rettuple = trigdata->tg_trigtuple;
+	else if (TRIGGER_FIRED_BY_UPDATE(trigdata->tg_event))
+		rettuple = trigdata->tg_newtuple;
+	else
+		elog(ERROR, "korean_tsvector_update_trigger: must be fired for INSERT or UPDATE");
+
+	trigger = trigdata->tg_trigger;
+	rel = trigdata->tg_relation;
+
+	if (trigger->tgnargs < 4)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("korean_tsvector_update_trigger: arguments must be tsvector_field, hash_field, ts_config, text_field1, ...")));
+
+	tsvcol = SPI_fnumber(rel->rd_att, trigger->tgargs[0]);
+	if (tsvcol <= 0 || SPI_gettypeid(rel->rd_att, tsvcol) != TSVECTOROID)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("tsvector column \"%s\" does not exist or is not of tsvector type",
+						trigger->tgargs[0])));
+
+	hashcol = SPI_fnumber(rel->rd_att, trigger->tgargs[1]);
+	if (hashcol <= 0 || SPI_gettypeid(rel->rd_att, hashcol) != INT8OID)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("hash column \"%s\" does not exist or is not of bigint type",
+						trigger->tgargs[1])));
+
+	cfgId = DatumGetObjectId(DirectFunctionCall1(regconfigin,
+												 CStringGetDatum(trigger->tgargs[2])));
+
+	/* 'title:A' 처럼 끝에 가중치, 없으면 0 */
+	ntexts = trigger->tgnargs - 3;
+	textcols = (int *) palloc(sizeof(int) * ntexts);
+	weights = (char *) palloc(ntexts);
+	for (i = 0; i < ntexts; i++)
+	{
+		char	   *name = pstrdup(trigger->tgargs[i + 3]);
+		int			len = strlen(name);
+
+		weights[i] = 0;
+		if (len > 2 && name[len - 2] == ':' &&
+			strchr("ABCDabcd", name[len - 1]) != NULL)
+		{
+			weights[i] = name[len - 1];
+			name[len - 2] = '\0';
+		}
+
+		textcols[i] = SPI_fnumber(rel->rd_att, name);
+		if (textcols[i] <= 0)
+			ereport(ERROR,
+					(errcode(ERRCODE_UNDEFINED_COLUMN),
+					 errmsg("column \"%s\" does not exist", name)));
+		if (!IsBinaryCoercible(SPI_gettypeid(rel->rd_att, textcols[i]), TEXTOID))
+			ereport(ERROR,
+					(errcode(ERRCODE_DATATYPE_MISMATCH),
+					 errmsg("column \"%s\" is not of a character type", name)));
+		pfree(name);
+	}
+
+	/*
+	 * 설정, 가중치, mecab 사전 설정과 사전 파일들 (model_stamp) 도 해시에 넣어서
+	 * 트리거를 바꾸거나 바뀐 사전을 읽으면 다시 분석하게 함. 사전 세대는
+	 * 서버를 다시 켜면 0 부터 다시 세므로 쓰지 않음. 설정 안의 사전 옵션이나
+	 * 불용어, 동의어 파일만 바꾼 것은 알 수 없음
+	 */
+	mecab_model_check();
+	hash = DatumGetUInt64(hash_any_extended((const unsigned char *) &cfgId,
+											sizeof(cfgId), 0));
+	hash = hash_combine64(hash, model_stamp);
+	if (mecab_dicdir != NULL)
+		hash = hash_combine64(hash,
+							  DatumGetUInt64(hash_any_extended((const unsigned char *) mecab_dicdir,
+															   strlen(mecab_dicdir), 2)));
+	if (mecab_userdic != NULL)
+		hash = hash_combine64(hash,
+							  DatumGetUInt64(hash_any_extended((const unsigned char *) mecab_userdic,
+															   strlen(mecab_userdic), 3)));
+	for (i = 0; i < ntexts; i++)
+	{
+		Datum		datum = SPI_getbinval(rettuple, rel->rd_att, textcols[i], &isnull);
+
+		hash = hash_combine64(hash, (uint64) weights[i]);
+		if (isnull)
+			hash = hash_combine64(hash, 0);
+		else
+		{
+			text	   *txt = DatumGetTextPP(datum);
+
+			hash = hash_combine64(hash,
+								  DatumGetUInt64(hash_any_extended((const unsigned char *) VARDATA_ANY(txt),
+																   VARSIZE_ANY_EXHDR(txt), 1)));
+		}
+	}
+
+	/* 원문이 그대로면 (tsvector 를 지우지 않았으면) 분석하지 않음 */
+	if (TRIGGER_FIRED_BY_UPDATE(trigdata->tg_event))
+	{
+		Datum		oldhash = SPI_getbinval(trigdata->tg_trigtuple, rel->rd_att,
+											hashcol, &isnull);
+
+		if (!isnull && (uint64) DatumGetInt64(oldhash) == hash)
+		{
+			(void) SPI_getbinval(rettuple, rel->rd_att, tsvcol, &isnull);
+			if (!isnull)
+				return PointerGetDatum(rettuple);
+		}
+	}
+
+	for (i = 0; i < ntexts; i++)
+	{
+		Datum		datum = SPI_getbinval(rettuple, rel->rd_att, textcols[i], &isnull);
+		Datum		part;
+
+		if (isnull)
+			continue;
+
+		part = DirectFunctionCall2(to_tsvector_byid, ObjectIdGetDatum(cfgId), datum);
+		if (weights[i] != 0)
+			part = DirectFunctionCall2(tsvector_setweight, part,
+									   CharGetDatum(weights[i]));
+		if (vector == (Datum) 0)
+			vector = part;
+		else
+			vector = DirectFunctionCall2(tsvector_concat, vector, part);
+	}
+
+	/* 원문 열이 모두 NULL 이면 빈 tsvector */
+	if (vector == (Datum) 0)
+		vector = DirectFunctionCall2(to_tsvector_byid, ObjectIdGetDatum(cfgId),
+									 PointerGetDatum(cstring_to_text("")));
+
+	cols[0] = tsvcol;
+	values[0] = vector;
+	cols[1] = hashcol;
+	values[1] = Int64GetDatum((int64) hash);
+
+	rettuple = heap_modify_tuple_by_cols(rettuple, rel->rd_att, 2, cols,
+										 values, nulls);
+
+	return PointerGetDatum(rettuple);
+}
+
+/*
+ * ts_mecabko_init - 사전 옵션 처리
+ * accept_pos = 'NNG,NNP,VV' 처럼 사전이 받아들일 품사를 바꿀 수 있다.
+ * 파서가 넘겨주는 단어는 기본 품사들 뿐이라서, 낱말 단위로는 그 안에서만
+ * 줄일 수 있고, 용언 활용 정보는 이 설정으로 모두 거른다.
+ * stopwords = 'korean' 이면 $SHAREDIR/tsearch_data/korean.stop 의 낱말들을,
+ * min_length, max_length 는 글자 수가 범위 밖인 낱말을 뺀다.
+ * compound = 'whole' | 'parts' | 'both' 는 복합명사 (무궁화 = 무궁+화) 를
+ * 그대로, 구성 명사들로, 또는 둘 다 색인한다.
+ * choseong, jamo_prefix 를 켜면 명사마다 초성, 자모 낱말도 넣어서
+ * korean_autocomplete_query 로 자동 완성을 색인으로 찾을 수 있다.
+ * synonyms = 'brands' 이면 $SHAREDIR/tsearch_data/brands.trie 에 있는 낱말을
+ * 거기 적힌 낱말들로 바꾼다.
+ * 사전을 처음 쓸 때 한번만 불리고, 결과는 사전 캐시에 남는다.
+ */
+Datum
+ts_mecabko_init(PG_FUNCTION_ARGS)
+{
+	List	   *options = (List *) PG_GETARG_POINTER(0);
+	mecabko_dict *dict;
+	ListCell   *l;
+	bool		stops_loaded = false;
+
+	dict = (mecabko_dict *) palloc0(sizeof(mecabko_dict));
+	dict->accept_pos = default_accept_pos;
+	dict->min_length = 1;
+
+	foreach(l, options)
+	{
+		DefElem    *defel = (DefElem *) lfirst(l);
+
+		if (pg_strcasecmp(defel->defname, "accept_pos") == 0)
+			dict->accept_pos = pos_set_parse(defGetString(defel));
+		else if (pg_strcasecmp(defel->defname, "stopwords") == 0)
+		{
+			if (stops_loaded)
+				ereport(ERROR,
+						(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						 errmsg("multiple StopWords parameters")));
+			dict_load_stopwords(dict, defGetString(defel));
+			stops_loaded = true;
+		}
+		else if (pg_strcasecmp(defel->defname, "synonyms") == 0)
+		{
+			if (dict->synonyms != NULL)
+				ereport(ERROR,
+						(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						 errmsg("multiple Synonyms parameters")));
+			dict->synonyms = synonym_trie_open(defGetString(defel));
+		}
+		else if (pg_strcasecmp(defel->defname, "compound") == 0)
+		{
+			const char *val = defGetString(defel);
+
+			if (pg_strcasecmp(val, "whole") == 0)
+				dict->compound = COMPOUND_WHOLE;
+			else if (pg_strcasecmp(val, "parts") == 0)
+				dict->compound = COMPOUND_PARTS;
+			else if (pg_strcasecmp(val, "both") == 0)
+				dict->compound = COMPOUND_BOTH;
+			else
+				ereport(ERROR,
+						(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						 errmsg("unrecognized compound mode: \"%s\"", val),
+						 errhint("Valid values are \"whole\", \"parts\" and \"both\".")));
+		}
+		else if (pg_strcasecmp(defel->defname, "choseong") == 0)
+			dict->choseong = defGetBoolean(defel);
+		else if (pg_strcasecmp(defel->defname, "jamo_prefix") == 0)
+			dict->jamo_prefix = defGetBoolean(defel);
+		else if (pg_strcasecmp(defel->defname, "min_length") == 0 ||
+				 pg_strcasecmp(defel->defname, "max_length") == 0)
+		{
+			int			val = pg_strtoint32(defGetString(defel));
+
+			if (val < 0)
+				ereport(ERROR,
+						(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						 errmsg("%s must be zero or positive", defel->defname)));
+			if (pg_strcasecmp(defel->defname, "min_length") == 0)
+				dict->min_length = val;
+			else
+				dict->max_length = val;
+		}
+		else
+			ereport(ERROR,
+					(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+					 errmsg("unrecognized mecabko dictionary parameter: \"%s\"",
+							defel->defname)));
+	}
+
+	if (dict->max_length > 0 && dict->min_length > dict->max_length)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("min_length must not be greater than max_length")));
+
+	PG_RETURN_POINTER(dict);
+}
+
+/*
+ * stop_hash - 검색 제외어 해시값
+ */
+static inline uint32
+stop_hash(const char *t, int tlen)
+{
+	return DatumGetUInt32(hash_any((const unsigned char *) t, tlen));
+}
+
+/*
+ * dict_load_stopwords - 검색 제외어 파일을 읽어 해시 집합으로
+ * 한 줄에 낱말 하나, 앞뒤 공백은 무시하고 빈 줄은 건너뜀.
+ * 칸 수는 낱말 수의 두배 이상인 2의 거듭제곱이라 찾기는 거의 한번에 끝남
+ */
+static void
+dict_load_stopwords(mecabko_dict *dict, const char *name)
+{
+	char	   *filename = get_tsearch_config_filename(name, "stop");
+	tsearch_readline_state trst;
+	List	   *words = NIL;
+	ListCell   *l;
+	char	   *line;
+	uint32		size = 16;
+
+	if (!tsearch_readline_begin(&trst, filename))
+		ereport(ERROR,
+				(errcode(ERRCODE_CONFIG_FILE_ERROR),
+				 errmsg("could not open stop-word file \"%s\": %m",
+						filename)));
+
+	while ((line = tsearch_readline(&trst)) != NULL)
+	{
+		char	   *start = line;
+		char	   *end;
+
+		while (isspace((unsigned char) *start))
+			start++;
+		end = start + strlen(start);
+		while (end > start && isspace((unsigned char) end[-1]))
+			end--;
+
+		if (end > start)
+			words = lappend(words, pnstrdup(start, end - start));
+		pfree(line);
+	}
+	tsearch_readline_end(&trst);
+
+	while (size < (uint32) list_length(words) * 2)
+		size <<= 1;
+	dict->stops = (stop_entry *) palloc0(sizeof(stop_entry) * size);
+	dict->stop_mask = size - 1;
+
+	foreach(l, words)
+	{
+		char	   *word = (char *) lfirst(l);
+		int			len = strlen(word);
+		uint32		hash = stop_hash(word, len);
+		uint32		h;
+
+		for (h = hash & dict->stop_mask; dict->stops[h].word != NULL;
+			 h = (h + 1) & dict->stop_mask)
+		{
+			if (dict->stops[h].hash == hash && dict->stops[h].len == len &&
+				memcmp(dict->stops[h].word, word, len) == 0)
+				break;
+		}
+		if (dict->stops[h].word != NULL)
+			continue;			/* 같은 낱말이 두번 */
+
+		dict->stops[h].hash = hash;
+		dict->stops[h].len = len;
+		dict->stops[h].word = word;
+		dict->nstops++;
+	}
+
+	list_free(words);
+	pfree(filename);
+}
+
+/*
+ * dict_accept_word - 색인할 낱말인지, 검색 제외어나 길이 제한에 걸리면 false
+ */
+static bool
+dict_accept_word(const mecabko_dict *dict, const char *t, int tlen)
+{
+	if (dict->min_length > 1 || dict->max_length > 0)
+	{
+		int			nchars = pg_mbstrlen_with_len(t, tlen);
+
+		if (nchars < dict->min_length ||
+			(dict->max_length > 0 && nchars > dict->max_length))
+			return false;
+	}
+
+	if (dict->stops != NULL)
+	{
+		uint32		hash = stop_hash(t, tlen);
+		uint32		h;
+
+		for (h = hash & dict->stop_mask; dict->stops[h].word != NULL;
+			 h = (h + 1) & dict->stop_mask)
+		{
+			if (dict->stops[h].hash == hash && dict->stops[h].len == tlen &&
+				memcmp(dict->stops[h].word, t, tlen) == 0)
+				return false;
+		}
+	}
+
+	return true;
+}
+
+/* 열어 둔 동의어 사전 파일들, 쓰는 사전이 없어지면 목록에서 빼고 풂 */
+static synonym_trie *synonym_tries = NULL;
+
+/*
+ * synonym_trie_open - 동의어 사전 파일을 mmap 함
+ * 다른 사전이 같은 파일을 쓰고 있으면 열어 둔 것을 쓰고, synonym_trie.pl 로
+ * 다시 만든 파일이면 새로 연다. 지금 메모리 컨텍스트 (사전 캐시가 사전마다
+ * 만드는 것) 가 지워질 때 synonym_trie_release 로 놓는다.
+ */
+static const synonym_trie *
+synonym_trie_open(const char *name)
+{
+	char	   *filename = get_tsearch_config_filename(name, "trie");
+	const synonym_header *header;
+	synonym_trie *trie;
+	MemoryContextCallback *cb;
+	struct stat st;
+	void	   *map;
+	int			fd;
+	int			save_errno;
+
+	cb = (MemoryContextCallback *) palloc(sizeof(MemoryContextCallback));
+	cb->func = synonym_trie_release;
+
+	fd = open(filename, O_RDONLY | PG_BINARY, 0);
+	if (fd < 0)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not open synonym file \"%s\": %m", filename)));
+	if (fstat(fd, &st) < 0)
+	{
+		save_errno = errno;
+		close(fd);
+		errno = save_errno;
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not stat synonym file \"%s\": %m", filename)));
+	}
+
+	for (trie = synonym_tries; trie != NULL; trie = trie->next)
+	{
+		if (trie->dev == st.st_dev && trie->ino == st.st_ino &&
+			trie->mtime == st.st_mtime && trie->size == st.st_size)
+		{
+			close(fd);
+			pfree(filename);
+			trie->refcount++;
+			cb->arg = trie;
+			MemoryContextRegisterResetCallback(CurrentMemoryContext, cb);
+			return trie;
+		}
+	}
+
+	if (st.st_size < sizeof(synonym_header))
+	{
+		close(fd);
+		ereport(ERROR,
+				(errcode(ERRCODE_CONFIG_FILE_ERROR),
+				 errmsg("invalid synonym file \"%s\"", filename),
+				 errhint("Build it with synonym_trie.pl.")));
+	}
+
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	save_errno = errno;
+	close(fd);
+	errno = save_errno;
+	if (map == MAP_FAILED)
+		ereport(ERROR,
+				(errcode_for_file_access(),
+				 errmsg("could not map synonym file \"%s\": %m", filename)));
+
+	/* 낱말 목록은 NUL 두 개로 끝나야 찾을 때 파일 밖을 읽지 않음 */
+	header = (const synonym_header *) map;
+	if (memcmp(header->magic, SYNONYM_MAGIC, sizeof(header->magic)) != 0 ||
+		header->nunits < 2 || header->values_len < 2 ||
+		sizeof(synonym_header) + (uint64) header->nunits * sizeof(synonym_unit) +
+		header->values_len != (uint64) st.st_size ||
+		((const char *) map)[st.st_size - 1] != '\0' ||
+		((const char *) map)[st.st_size - 2] != '\0')
+	{
+		munmap(map, st.st_size);
+		ereport(ERROR,
+				(errcode(ERRCODE_CONFIG_FILE_ERROR),
+				 errmsg("invalid synonym file \"%s\"", filename),
+				 errhint("Build it with synonym_trie.pl.")));
+	}
+
+	trie = (synonym_trie *) MemoryContextAllocZero(TopMemoryContext,
+												   sizeof(synonym_trie));
+	trie->dev = st.st_dev;
+	trie->ino = st.st_ino;
+	trie->mtime = st.st_mtime;
+	trie->size = st.st_size;
+	trie->map = map;
+	trie->refcount = 1;
+	trie->units = (const synonym_unit *) ((const char *) map + sizeof(synonym_header));
+	trie->nunits = header->nunits;
+	trie->values = (const char *) (trie->units + trie->nunits);
+	trie->values_len = header->values_len;
+	trie->next = synonym_tries;
+	synonym_tries = trie;
+	cb->arg = trie;
+	MemoryContextRegisterResetCallback(CurrentMemoryContext, cb);
+
+	elog(DEBUG1, "textsearch_ko: mapped synonym file \"%s\" (%u entries)",
+		 filename, header->nkeys);
+	pfree(filename);
+
+	return trie;
+}
+
+/*
+ * synonym_trie_release - 사전을 지울 때 동의어 사전 파일을 놓음
+ * 쓰는 사전이 없으면 풀어서, 파일을 바꾼 뒤 사전을 다시 만들면 예전 파일이
+ * 백엔드에 남지 않게 함
+ */
+static void
+synonym_trie_release(void *arg)
+{
+	synonym_trie *trie = (synonym_trie *) arg;
+	synonym_trie **p;
+
+	if (--trie->refcount > 0)
+		return;
+
+	for (p = &synonym_tries; *p != NULL; p = &(*p)->next)
+	{
+		if (*p == trie)
+		{
+			*p = trie->next;
+			break;
+		}
+	}
+
+	munmap(trie->map, trie->size);
+	pfree(trie);
+}
+
+/*
+ * synonym_lookup - 낱말을 더블 어레이에서 찾아 바꿀 낱말 목록을 돌려줌, 없으면 NULL
+ * 칸 1 이 뿌리, 바이트 b 는 base + b + 1 칸, 낱말 끝은 base + 0 칸
+ */
+static const char *
+synonym_lookup(const synonym_trie *trie, const char *key, int len)
+{
+	uint32		s = 1;
+	int64		offset;
+	int			i;
+
+	for (i = 0; i <= len; i++)
+	{
+		int64		t = (int64) trie->units[s].base +
+			(i < len ? (unsigned char) key[i] + 1 : 0);
+
+		if (t <= 0 || t >= trie->nunits || trie->units[t].check != s)
+			return NULL;
+		s = (uint32) t;
+	}
+
+	offset = -(int64) trie->units[s].base - 1;
+	if (offset < 0 || offset >= trie->values_len)
+		return NULL;
+
+	return trie->values + offset;
+}
+
+/*
+ * synonym_expand - 낱말마다 동의어 사전을 찾아, 있으면 적힌 낱말들로 바꿈
+ * 바꾼 낱말들은 원래 낱말의 nvariant 를 그대로 써서 같은 자리에 모두 들어감.
+ * 바꾼 것이 없으면 res 를 그대로, 있으면 새 배열을 돌려주고 *nres 를 고침
+ */
+static TSLexeme *
+synonym_expand(const synonym_trie *trie, TSLexeme *res, int *nres)
+{
+	const char **found;
+	TSLexeme   *out;
+	const char *v;
+	bool		any = false;
+	int			nout = 0;
+	int			n = 0;
+	int			i;
+
+	found = (const char **) palloc(sizeof(char *) * *nres);
+	for (i = 0; i < *nres; i++)
+	{
+		found[i] = synonym_lookup(trie, res[i].lexeme, strlen(res[i].lexeme));
+		if (found[i] == NULL)
+		{
+			nout++;
+			continue;
+		}
+		any = true;
+		for (v = found[i]; *v; v += strlen(v) + 1)
+			nout++;
+	}
+
+	if (!any)
+	{
+		pfree(found);
+		return res;
+	}
+
+	out = (TSLexeme *) palloc0(sizeof(TSLexeme) * (nout + 1));
+	for (i = 0; i < *nres; i++)
+	{
+		if (found[i] == NULL)
+		{
+			out[n++] = res[i];
+			continue;
+		}
+		for (v = found[i]; *v; v += strlen(v) + 1)
+		{
+			out[n].lexeme = pstrdup(v);
+			out[n].nvariant = res[i].nvariant;
+			out[n++].flags = res[i].flags;
+		}
+		pfree(res[i].lexeme);
+	}
+
+	pfree(found);
+	pfree(res);
+	*nres = n;
+
+	return out;
+}
+
+/*
+ * ts_mecabko_lexize - 사전처리
+ * 파서가 넘겨준 토큰이면 파싱할 때 분석한 형태소로 처리하고,
+ * ts_lexize 처럼 파서를 거치지 않은 단어는 그 단어를 직접 분석한다.
+ *
+ * 이 함수로 넘어오는 단어는 형태소 분석기가 의미 단위로 분리한 그 단어가 넘어온다.
+ * 예를 들어 '가까워졌음을'이 입력되면, {가깝,어,지,었,음,을} 로 분리하거나,
+ * 약어, 동의어, 자동수정 등 기능을 할 수 있다.
+ * 
+ * 용언 활용을 나누고, 사전에 synonyms 가 있으면 나온 낱말들을 동의어 사전으로 바꾼다.
+ */
+Datum
+ts_mecabko_lexize(PG_FUNCTION_ARGS)
+{
+	mecabko_dict *dict = (mecabko_dict *) PG_GETARG_POINTER(0);
+	const char *t = (char *) PG_GETARG_POINTER(1);
+	int			tlen = PG_GETARG_INT32(2);
+	const mecab_morph *morph;
+	TSLexeme   *res;
+	int			nres;
+	instr_time	start;
+
+	TRACE_TEXTSEARCH_KO_LEXIZE_START(tlen);
+	stats_timer_start(start);
+
+	if (dict == NULL)
+		dict = &default_dict;
+
+	morph = parser_lookup_morph(t, tlen);
+	if (morph != NULL)
+	{
+		res = palloc0(sizeof(TSLexeme) * (morph->npieces + MORPH_EXTRA_LEXEMES + 2));
+		nres = morph_lexemes(morph, dict, t, res);
+	}
+	else
+	{
+		mecab_result *analysis = analysis_acquire(t, tlen, ANALYSIS_FULL);
+		int		   *nper;
+		int			i;
+
+		nres = 1;
+		for (i = 0; i < analysis->nmorphs; i++)
+			nres += analysis->morphs[i].npieces + MORPH_EXTRA_LEXEMES + 1;
+
+		res = palloc0(sizeof(TSLexeme) * nres);
+		nper = (int *) palloc(sizeof(int) * Max(analysis->nmorphs, 1));
+		nres = 0;
+		for (i = 0; i < analysis->nmorphs; i++)
+		{
+			morph = &analysis->morphs[i];
+			nper[i] = morph_lexemes(morph, dict,
+									analysis->text + morph->offset, res + nres);
+			nres += nper[i];
+		}
+
+		/* 형태소가 여럿이면 모두 있어야 하므로 형태소마다 하나씩 고른 조합으로 */
+		if (analysis->nmorphs > 1)
+			res = lexeme_combine(res, nper, analysis->nmorphs, &nres);
+
+		pfree(nper);
+		analysis_release(analysis);
+	}
+
+	if (dict->synonyms != NULL && nres > 0)
+		res = synonym_expand(dict->synonyms, res, &nres);
+
+	stats_timer_stop(STATS_LEXIZE_TIME, start);
+	TRACE_TEXTSEARCH_KO_LEXIZE_DONE(tlen, nres);
+
+	PG_RETURN_POINTER(res);
+}
+
+/*
+ * morph_lexemes - 형태소 하나에서 색인할 단어들을 res 에 넣음
+ * 용언 활용이면 활용 정보 조각들로, 아니면 기본형으로, 넣은 갯수 반환
+ * 복합명사는 사전의 compound 설정에 따라 구성 명사들도 넣는데,
+ * 둘 다 넣을 때는 검색어에서 "복합명사 | (구성 명사 & ...)" 가 되도록
+ * nvariant 를 나눈다.
+ * 초성, 자모 낱말은 낱말과 함께 nvariant 가 다른 묶음으로 넣어서, 검색어가
+ * "낱말 | (낱말 & 초성 & 자모)" 곧 낱말 하나와 같은 뜻이 되게 한다.
+ */
+static int
+morph_lexemes(const mecab_morph *m, const mecabko_dict *dict,
+			  const char *surface, TSLexeme *res)
+{
+	const char *t;
+	int			tlen;
+	int			n = 0;
+
+	if (morph_is_inflect(m))
+	{
+		stats_add(STATS_INFLECTS, 1);
+		n = morph_piece_lexemes(m, dict, 0, res);
+	}
+	else if (dict->accept_pos & POS_BIT(m->pos))
+	{
+		bool		parts = (m->conjtype == CONJ_COMPOUND && m->npieces > 0 &&
+							 dict->compound != COMPOUND_WHOLE);
+
+		if (!parts || dict->compound == COMPOUND_BOTH)
+		{
+			if (!morph_field(m, MECAB_BASIC, &t, &tlen))
+			{
+				t = surface;
+				tlen = m->length;
+			}
+			if (dict_accept_word(dict, t, tlen))
+			{
+				res[n].lexeme = lexize(t, tlen);
+				res[n++].nvariant = (parts ? 1 : 0);
+				if (jamo_pos & POS_BIT(m->pos))
+				{
+					uint16		nvariant = (parts ? 3 : 1);
+					int			njamo = jamo_lexemes(dict, t, tlen, nvariant,
+													 res + n + 1);
+
+					if (njamo > 0)
+					{
+						res[n].lexeme = lexize(t, tlen);
+						res[n].nvariant = nvariant;
+						n += njamo + 1;
+					}
+				}
+			}
+			else
+				stats_add(STATS_FILTERED, 1);
+		}
+		if (parts)
+			n += morph_piece_lexemes(m, dict,
+									 (dict->compound == COMPOUND_BOTH) ? 2 : 0,
+									 res + n);
+	}
+	else
+		stats_add(STATS_FILTERED, 1);
+
+	/* 사전에서 뺀 품사는 검색 제외어로 처리 */
+	stats_add(STATS_LEXEMES, n);
+	return n;
+}
+
+/*
+ * morph_piece_lexemes - 활용 정보 (MECAB_DETAIL) 조각들을 res 에 넣음
+ * 용언 활용과 복합명사 나누기에 씀, 넣은 갯수 반환
+ */
+static int
+morph_piece_lexemes(const mecab_morph *m, const mecabko_dict *dict,
+					uint16 nvariant, TSLexeme *res)
+{
+	const mecab_piece *piece = m->pieces;
+	int			n = 0;
+	int			i;
+
+	for (i = 0; i < m->npieces; i++, piece++)
+	{
+		const char *t = m->feature + piece->offset;
+		int			tlen = piece->length;
+
+		/* 제외 품사, 검색 제외어면 통과 */
+		if ((dict->accept_pos & POS_BIT(piece->pos)) &&
+			dict_accept_word(dict, t, tlen))
+		{
+			res[n].lexeme = lexize(t, tlen);
+			res[n++].nvariant = nvariant;
+		}
+		else
+			stats_add(STATS_FILTERED, 1);
+	}
+
+	return n;
+}
+
+/*
+ * jamo_lexemes - 사전 설정에 따라 초성, 자모 낱말을 res 에 넣음, 넣은 갯수 반환
+ */
+static int
+jamo_lexemes(const mecabko_dict *dict, const char *t, int tlen,
+			 uint16 nvariant, TSLexeme *res)
+{
+	StringInfoData	str;
+	int				n = 0;
+
+	if (dict->choseong)
+	{
+		initStringInfo(&str);
+		if (jamo_choseong(&str, t, tlen))
+		{
+			res[n].lexeme = str.data;
+			res[n++].nvariant = nvariant;
+		}
+		else
+			pfree(str.data);
+	}
+	if (dict->jamo_prefix)
+	{
+		initStringInfo(&str);
+		if (jamo_keys(&str, t, tlen))
+		{
+			res[n].lexeme = str.data;
+			res[n++].nvariant = nvariant;
+		}
+		else
+			pfree(str.data);
+	}
+
+	return n;
+}
+
+/* lexeme_combine 이 만들 최대 조합 수, 넘으면 형태소마다 첫 묶음만 씀 */
+#define MAX_LEXEME_COMBINATIONS	16
+
+/*
+ * lexeme_combine - 형태소 여럿에서 나온 단어들 (res, 형태소마다 nper 개) 을
+ * 검색어에서 "형태소1 & 형태소2 & ..." 가 되도록 nvariant 를 다시 매김
+ * 형태소 하나 안에서 nvariant 가 다른 묶음들 (복합명사 | 구성 명사들) 은 서로
+ * 바꿔 쓸 수 있는 것이므로, 형태소마다 묶음 하나씩 고른 조합마다 nvariant 를
+ * 하나씩 주고 단어들을 복사해 넣음. 새 배열을 돌려주고 *nres 를 고침
+ */
+static TSLexeme *
+lexeme_combine(TSLexeme *res, const int *nper, int nmorphs, int *nres)
+{
+	int		   *first;			/* 형태소마다 첫 단어 위치 */
+	int		   *ngroups;		/* 형태소마다 묶음 수 */
+	int		   *pick;			/* 지금 조합에서 고른 묶음 */
+	TSLexeme   *out;
+	int			ncombs = 1;
+	int			nout = 0;
+	int			n = 0;
+	int			c;
+	int			i;
+	int			j;
+
+	first = (int *) palloc(sizeof(int) * nmorphs);
+	ngroups = (int *) palloc(sizeof(int) * nmorphs);
+	pick = (int *) palloc0(sizeof(int) * nmorphs);
+
+	for (i = 0; i < nmorphs; i++)
+	{
+		first[i] = n;
+		ngroups[i] = (nper[i] > 0) ? 1 : 0;
+		for (j = n + 1; j < n + nper[i]; j++)
+		{
+			if (res[j].nvariant != res[j - 1].nvariant)
+				ngroups[i]++;
+		}
+		n += nper[i];
+		if (ngroups[i] > 1 && ncombs <= MAX_LEXEME_COMBINATIONS)
+			ncombs *= ngroups[i];
+	}
+
+	/* 묶음이 하나씩이면 모두 있어야 하는 한 묶음 */
+	if (ncombs == 1)
+	{
+		for (i = 0; i < *nres; i++)
+			res[i].nvariant = 0;
+		pfree(first);
+		pfree(ngroups);
+		pfree(pick);
+		return res;
+	}
+
+	if (ncombs > MAX_LEXEME_COMBINATIONS)
+	{
+		for (i = 0; i < nmorphs; i++)
+			ngroups[i] = Min(ngroups[i], 1);
+		ncombs = 1;
+	}
+
+	out = (TSLexeme *) palloc0(sizeof(TSLexeme) * (ncombs * *nres + 1));
+	for (c = 0; c < ncombs; c++)
+	{
+		for (i = 0; i < nmorphs; i++)
+		{
+			int			g = 0;
+
+			if (ngroups[i] == 0)
+				continue;
+
+			/* 고른 묶음 pick[i] 의 단어들 */
+			for (j = first[i]; j < first[i] + nper[i]; j++)
+			{
+				if (j > first[i] && res[j].nvariant != res[j - 1].nvariant)
+					g++;
+				if (g > pick[i])
+					break;
+				if (g == pick[i])
+				{
+					out[nout].lexeme = pstrdup(res[j].lexeme);
+					out[nout].flags = res[j].flags;
+					out[nout++].nvariant = c;
+				}
+			}
+		}
+
+		/* 다음 조합 */
+		for (i = nmorphs - 1; i >= 0; i--)
+		{
+			if (ngroups[i] == 0)
+				continue;
+			if (++pick[i] < ngroups[i])
+				break;
+			pick[i] = 0;
+		}
+	}
+
+	for (i = 0; i < *nres; i++)
+		pfree(res[i].lexeme);
+	pfree(res);
+	pfree(first);
+	pfree(ngroups);
+	pfree(pick);
+
+	*nres = nout;
+	return out;
+}
+
+#define make_text(s, ln) \
+	PointerGetDatum(cstring_to_text_with_len((s), (ln)))
+
+#if PG_VERSION_NUM < 160000
+/*
+ * InitMaterializedSRF - PG16 의 같은 이름 함수, 예전 버전용
+ * 결과를 tuplestore 에 한번에 담아 돌려주도록 준비
+ */
+static void
+InitMaterializedSRF(FunctionCallInfo fcinfo, bits32 flags)
+{
+	ReturnSetInfo  *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	MemoryContext	oldcontext;
+	TupleDesc		tupdesc;
+
+	if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("set-valued function called in context that cannot accept a set")));
+	if (!(rsinfo->allowedModes & SFRM_Materialize))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("materialize mode required, but it is not allowed in this context")));
+
+	oldcontext = MemoryContextSwitchTo(rsinfo->econtext->ecxt_per_query_memory);
+
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return and sql tuple descriptions are incompatible");
+
+	rsinfo->returnMode = SFRM_Materialize;
+	rsinfo->setResult = tuplestore_begin_heap(rsinfo->allowedModes & SFRM_Materialize_Random,
+											  false, work_mem);
+	rsinfo->setDesc = tupdesc;
+
+	MemoryContextSwitchTo(oldcontext);
+}
+#endif
+
+/*
+ * analyze_put_rows - mecabko_analyze 결과 줄들을 tuplestore 에 담음
+ * 형태소마다 한 줄, 용언 활용형은 상세 정보 형태소마다 한 줄
+ */
+static void
+analyze_put_rows(ReturnSetInfo *rsinfo, const mecab_result *analysis,
+				 MemoryContext rowcontext)
+{
+	const mecab_morph *node;
+
+	for (node = analysis->morphs;
+		 node < analysis->morphs + analysis->nmorphs; node++)
+	{
+		const char *surface = analysis->text + node->offset;
+		int		i;
+		Datum		values[NUM_CSV+1];
+		bool		nulls[NUM_CSV+1] = { 0 };
+
+		/* 단어 처리
+		 * conjtype 값이 Inflect 이면, 
+		 * detail 기준으로 row로 분리 */
+
+		if (morph_is_inflect(node)){
+			const mecab_piece *piece = node->pieces;
+			int		j;
+
+			/* 용언 상세 정보로 처리, 없으면 그대로 */
+			for (j = 0; j < node->npieces; j++, piece++) {
+				const char *psurface = node->feature + piece->offset;
+
+				values[0] = make_text(psurface, piece->length);
+				for (i = 1; i <= NUM_CSV; i++)
+				{
+					if(i == 1){
+						values[i] = make_text(node->feature + piece->tag_offset,
+											  piece->tag_length);
+					}
+					else if(i==3){
+						values[i] = make_text("F",1);
+					}
+					else if(i==4){
+						values[i] = make_text(psurface, piece->length);
+					}
+					else {
+						nulls[i] = true;
+					}
+				}
+				tuplestore_putvalues(rsinfo->setResult, rsinfo->setDesc, values, nulls);
+				MemoryContextReset(rowcontext);
+			}
+		}
+		else {
+			values[0] = make_text(surface, node->length);
+
+			for (i = 1; i <= NUM_CSV; i++)
+			{
+				const char *t;
+				int			tlen;
+
+				if (i > node->nfields)
+				{
+					/* 未知語 */
+					if (i <= MECAB_BASIC)
+						nulls[i] = true;
+					else
+						values[i] = make_text(surface, node->length);
+				}
+				else if (morph_field(node, i - 1, &t, &tlen))
+					values[i] = make_text(t, tlen);
+				else if (i == MECAB_BASIC + 1)
+					values[i] = make_text(surface, node->length);
+				else
+					nulls[i] = true;
+			}
+			tuplestore_putvalues(rsinfo->setResult, rsinfo->setDesc, values, nulls);
+			MemoryContextReset(rowcontext);
+		}
+
+	}
+}
+
+/*
+ * mecabko_analyze - mecab node dump
+ * 큰 문자열은 조각씩 분석하고, 형태소마다 한 줄씩 바로 tuplestore 에 담음
+ */
+Datum
+mecabko_analyze(PG_FUNCTION_ARGS)
+{
+	Datum			arg = PG_GETARG_DATUM(0);
+	ReturnSetInfo  *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	chunk_reader	reader;
+	const char	   *chunk;
+	int				chunklen;
+	MemoryContext	rowcontext;
+	MemoryContext	oldcontext;
+
+	InitMaterializedSRF(fcinfo, 0);
+
+	/* 줄마다 만드는 text 값들은 tuplestore 에 넣고 바로 버림 */
+	rowcontext = AllocSetContextCreate(CurrentMemoryContext,
+									   "mecabko_analyze row",
+									   ALLOCSET_SMALL_SIZES);
+
+	chunk_reader_init(&reader, arg);
+	while (chunk_reader_next(&reader, &chunk, &chunklen))
+	{
+		mecab_result   *analysis;
+
+		analysis = analysis_acquire(chunk, chunklen, ANALYSIS_FULL);
+		oldcontext = MemoryContextSwitchTo(rowcontext);
+		analyze_put_rows(rsinfo, analysis, rowcontext);
+		MemoryContextSwitchTo(oldcontext);
+		analysis_release(analysis);
+	}
+	chunk_reader_end(&reader, arg);
+
+	MemoryContextDelete(rowcontext);
+
+	return (Datum) 0;
+}
+
+/*
+ * tokens_put_rows - mecabko_tokens 결과 줄들을 tuplestore 에 담음
+ * base 는 조각의 입력 안 바이트 위치
+ */
+static void
+tokens_put_rows(ReturnSetInfo *rsinfo, const mecab_result *analysis,
+				MemoryContext rowcontext, int base)
+{
+	const mecab_morph *node;
+
+	for (node = analysis->morphs;
+		 node < analysis->morphs + analysis->nmorphs; node++)
+	{
+		const char *surface = analysis->text + node->offset;
+		const char *t;
+		int			tlen;
+		Datum		values[5];
+		bool		nulls[5] = { 0 };
+
+		values[0] = make_text(surface, node->length);
+
+		if (morph_field(node, MECAB_POS, &t, &tlen))
+			values[1] = make_text(t, tlen);
+		else
+			nulls[1] = true;
+
+		if (morph_is_inflect(node) && node->npieces > 0)
+			values[2] = make_text(node->feature + node->pieces[0].offset,
+								  node->pieces[0].length);
+		else if (morph_field(node, MECAB_BASIC, &t, &tlen))
+			values[2] = make_text(t, tlen);
+		else
+			values[2] = values[0];
+
+		values[3] = Int32GetDatum(base + node->offset);
+		values[4] = Int32GetDatum(base + node->offset + node->length);
+
+		tuplestore_putvalues(rsinfo->setResult, rsinfo->setDesc, values, nulls);
+		MemoryContextReset(rowcontext);
+	}
+}
+
+/*
+ * mecabko_tokens - 형태소마다 낱말, 품사, 기본형, 바이트 위치만
+ * 용언 활용형 (Inflect) 의 기본형은 상세 정보의 첫 형태소 (가까워 -> 가깝),
+ * 나머지는 MECAB_BASIC 값 (없으면 낱말 그대로)
+ * byte_start, byte_end 는 입력 문자열 안의 바이트 위치 (0 부터, 끝은 포함 안 함)
+ */
+Datum
+mecabko_tokens(PG_FUNCTION_ARGS)
+{
+	Datum			arg = PG_GETARG_DATUM(0);
+	ReturnSetInfo  *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	chunk_reader	reader;
+	const char	   *chunk;
+	int				chunklen;
+	MemoryContext	rowcontext;
+	MemoryContext	oldcontext;
+
+	InitMaterializedSRF(fcinfo, 0);
+
+	rowcontext = AllocSetContextCreate(CurrentMemoryContext,
+									   "mecabko_tokens row",
+									   ALLOCSET_SMALL_SIZES);
+
+	chunk_reader_init(&reader, arg);
+	while (chunk_reader_next(&reader, &chunk, &chunklen))
+	{
+		mecab_result   *analysis;
+
+		analysis = analysis_acquire(chunk, chunklen, ANALYSIS_FULL);
+		oldcontext = MemoryContextSwitchTo(rowcontext);
+		tokens_put_rows(rsinfo, analysis, rowcontext,
+						reader.offset - chunklen);
+		MemoryContextSwitchTo(oldcontext);
+		analysis_release(analysis);
+	}
+	chunk_reader_end(&reader, arg);
+
+	MemoryContextDelete(rowcontext);
+
+	return (Datum) 0;
+}
+
+/*
+ * korean_normalize - normalize 함수 랩퍼
+ * 
+ */
+Datum
+korean_normalize(PG_FUNCTION_ARGS)
+{
+	Datum			r;
+	text		   *txt = PG_GETARG_TEXT_PP(0);
+	StringInfoData	str;
+
+	initStringInfo(&str);
+	normalize(&str, VARDATA_ANY(txt), VARSIZE_ANY_EXHDR(txt), NULL);
+	PG_FREE_IF_COPY(txt, 0);
+
+	r = CStringGetTextDatum(str.data);
+	pfree(str.data);
+
+	PG_RETURN_DATUM(r);
+}
+
+/*
+ * hanja_convert_mecab - mecab 사전에 있는 한자 낱말은 사전 독음으로,
+ * 나머지는 hanja_convert 로 바꿈
+ */
+static void
+hanja_convert_mecab(StringInfo dst, const char *src, int srclen,
+					pg_wchar *prev_hangul)
+{
+	mecab_result   *analysis;
+	const mecab_morph *node;
+	int				done = 0;
+
+	analysis = analysis_acquire(src, srclen, ANALYSIS_FULL);
+
+	for (node = analysis->morphs;
+		 node < analysis->morphs + analysis->nmorphs; node++)
+	{
+		const char *surface = analysis->text + node->offset;
+		const char *s;
+		const char *sori;
+		int			sorilen;
+
+		/* 형태소 사이 공백 */
+		hanja_convert(dst, analysis->text + done, node->offset - done,
+					  prev_hangul);
+		done = node->offset + node->length;
+
+		for (s = surface; s < surface + node->length; s += uchar_mblen(s))
+		{
+			if (IS_HANJA_LEAD((const unsigned char *) s))
+				break;
+		}
+
+		if (s < surface + node->length &&
+			morph_field(node, MECAB_BASIC, &sori, &sorilen))
+		{
+			appendBinaryStringInfo(dst, sori, sorilen);
+			s = sori + sorilen - 3;
+			*prev_hangul = (sorilen >= 3 && IS_HANGUL_LEAD((const unsigned char *) s)) ?
+				utf8_to_unicode((const unsigned char *) s) : 0;
+		}
+		else
+			hanja_convert(dst, surface, node->length, prev_hangul);
+	}
+	hanja_convert(dst, analysis->text + done, analysis->textlen - done,
+				  prev_hangul);
+
+	analysis_release(analysis);
+}
+
+/*
+ * hanja2hangul - 한자를 한글로 변환
+ * 한자 독음 표로 바꾸고, 나머지 글자와 공백은 그대로 둠
+ * 두번째 인자가 참이면 mecab 사전에 있는 한자 낱말은 사전 독음을 씀
+ * (樂園 -> 낙원 처럼 표에 있는 소리 (악) 와 다르게 읽는 낱말)
+ * 큰 문자열은 조각씩 읽어서 바꿈
+ */
+Datum
+hanja2hangul(PG_FUNCTION_ARGS)
+{
+	Datum			arg = PG_GETARG_DATUM(0);
+	bool			use_mecab = PG_NARGS() > 1 && PG_GETARG_BOOL(1);
+	chunk_reader	reader;
+	const char	   *chunk;
+	int				chunklen;
+	StringInfoData	str;
+	pg_wchar		prev_hangul = 0;
+
+	initStringInfo(&str);
+
+	chunk_reader_init(&reader, arg);
+	while (chunk_reader_next(&reader, &chunk, &chunklen))
+	{
+		if (use_mecab)
+			hanja_convert_mecab(&str, chunk, chunklen, &prev_hangul);
+		else
+			hanja_convert(&str, chunk, chunklen, &prev_hangul);
+	}
+	chunk_reader_end(&reader, arg);
+
+	PG_RETURN_DATUM(CStringGetTextDatum(str.data));
+}
+
+/*
+ * korean_autocomplete_query - 입력 중인 검색어로 자동 완성 tsquery 만들기
+ * 띄어쓴 낱말마다, 자음만 있으면 (ㅁㄱ) 초성 낱말, 아니면 자모 낱말로 바꿔
+ * 앞부분 일치 (:*) 로 묶음. 쓰다 만 글자 (무구, 묵) 도 찾도록 자모는
+ * 글쇠 단위로 나눔 (ㅘ -> ㅗㅏ, ㄺ -> ㄹㄱ).
+ * choseong, jamo_prefix 를 켠 mecabko 사전으로 만든 색인에 씀
+ */
+Datum
+korean_autocomplete_query(PG_FUNCTION_ARGS)
+{
+	text		   *txt = PG_GETARG_TEXT_PP(0);
+	const char	   *s = VARDATA_ANY(txt);
+	const char	   *end = s + VARSIZE_ANY_EXHDR(txt);
+	StringInfoData	str;
+	StringInfoData	word;
+
+	initStringInfo(&str);
+	initStringInfo(&word);
+
+	while (s < end)
+	{
+		const char *start;
+		bool		consonants = true;
+
+		while (s < end && isspace((unsigned char) *s))
+			s++;
+		if (s >= end)
+			break;
+
+		start = s;
+		while (s < end && !isspace((unsigned char) *s))
+		{
+			int			len = Min(uchar_mblen(s), end - s);
+			pg_wchar	ch = (len == 3) ? utf8_to_unicode((const unsigned char *) s) : 0;
+
+			if (ch < JAMO_FIRST || ch > JAMO_CONS_LAST)
+				consonants = false;
+			s += len;
+		}
+
+		resetStringInfo(&word);
+		if (consonants)
+			appendBinaryStringInfo(&word, start, s - start);
+		else
+			jamo_keys(&word, start, s - start);
+
+		if (str.len > 0)
+			appendStringInfoString(&str, " & ");
+		tsquery_append_lexeme(&str, word.data, word.len);
+		appendStringInfoString(&str, ":*");
+	}
+	PG_FREE_IF_COPY(txt, 0);
+
+	if (str.len == 0)
+		PG_RETURN_TSQUERY(tsquery_empty());
+
+	PG_RETURN_DATUM(DirectFunctionCall1(tsqueryin, CStringGetDatum(str.data)));
+}
+
+/*
+ * bigram_query_word - 띄어쓴 낱말 하나를 나눈 낱말들 (prs) 을 차례로 묶음
+ * 위치마다 첫 낱말만 씀. 두 글자씩 나눈 끝의 한 글자는 앞 낱말 끝 글자와
+ * 같으면 빼고, 남은 끝 낱말이 한 글자이면 앞부분 일치로
+ */
+static void
+bigram_query_word(StringInfo dst, const ParsedText *prs)
+{
+	ParsedWord **words;
+	ParsedWord *last;
+	int			n = 0;
+	int			i;
+
+	if (prs->curwords == 0)
+		return;
+
+	words = (ParsedWord **) palloc(sizeof(ParsedWord *) * prs->curwords);
+	for (i = 0; i < prs->curwords; i++)
+	{
+		if (n == 0 || prs->words[i].pos.pos != words[n - 1]->pos.pos)
+			words[n++] = &prs->words[i];
+	}
+
+	last = words[n - 1];
+	if (n >= 2 && IS_HIGHBIT_SET(*last->word) &&
+		uchar_mblen(last->word) == last->len &&
+		words[n - 2]->len > last->len &&
+		memcmp(words[n - 2]->word + words[n - 2]->len - last->len,
+			   last->word, last->len) == 0)
+		n--;
+
+	if (dst->len > 0)
+		appendStringInfoString(dst, " & ");
+	if (n > 1)
+		appendStringInfoChar(dst, '(');
+	for (i = 0; i < n; i++)
+	{
+		ParsedWord *w = words[i];
+
+		if (i > 0)
+		{
+			int			distance = w->pos.pos - words[i - 1]->pos.pos;
+
+			if (distance == 1)
+				appendStringInfoString(dst, " <-> ");
+			else
+				appendStringInfo(dst, " <%d> ", distance);
+		}
+		tsquery_append_lexeme(dst, w->word, w->len);
+		if ((w->flags & TSL_PREFIX) ||
+			(i == n - 1 && IS_HIGHBIT_SET(*w->word) &&
+			 uchar_mblen(w->word) == w->len))
+			appendStringInfoString(dst, ":*");
+	}
+	if (n > 1)
+		appendStringInfoChar(dst, ')');
+
+	pfree(words);
+}
+
+/*
+ * korean_bigram_query_byid - korean_bigram 설정으로 만든 색인을 찾을 tsquery
+ * 띄어쓴 낱말마다 색인과 같은 설정으로 나눠 차례 (<->) 로 묶고, 낱말끼리는 &.
+ * 무궁화 -> '무궁' <-> '궁화', 꽃 -> '꽃':*
+ * 다른 설정으로도 부를 수 있으며 그때는 나눈 낱말들의 구절 검색어가 됨
+ */
+Datum
+korean_bigram_query_byid(PG_FUNCTION_ARGS)
+{
+	Oid				cfgId = PG_GETARG_OID(0);
+	text		   *txt = PG_GETARG_TEXT_PP(1);
+	const char	   *s = VARDATA_ANY(txt);
+	const char	   *end = s + VARSIZE_ANY_EXHDR(txt);
+	StringInfoData	str;
+	ParsedText		prs;
+
+	initStringInfo(&str);
+
+	prs.lenwords = 16;
+	prs.words = (ParsedWord *) palloc(sizeof(ParsedWord) * prs.lenwords);
+
+	while (s < end)
+	{
+		const char *start;
+
+		while (s < end && isspace((unsigned char) *s))
+			s++;
+		if (s >= end)
+			break;
+
+		start = s;
+		while (s < end && !isspace((unsigned char) *s))
+			s++;
+
+		prs.curwords = 0;
+		prs.pos = 0;
+		parsetext(cfgId, &prs, (char *) start, s - start);
+		bigram_query_word(&str, &prs);
+	}
+	PG_FREE_IF_COPY(txt, 1);
+
+	if (str.len == 0)
+		PG_RETURN_TSQUERY(tsquery_empty());
+
+	PG_RETURN_DATUM(DirectFunctionCall1(tsqueryin, CStringGetDatum(str.data)));
+}
+
+/*
+ * korean_bigram_query - 기본 검색 설정으로 korean_bigram_query_byid
+ */
+Datum
+korean_bigram_query(PG_FUNCTION_ARGS)
+{
+	PG_RETURN_DATUM(DirectFunctionCall2(korean_bigram_query_byid,
+										ObjectIdGetDatum(getTSCurrentConfig(true)),
+										PG_GETARG_DATUM(0)));
+}
+
+/*
+ * tsquery_append_lexeme - tsqueryin 에 넘길 따옴표 친 낱말을 붙임
+ */
+static void
+tsquery_append_lexeme(StringInfo dst, const char *s, int len)
+{
+	const char *end = s + len;
+
+	appendStringInfoChar(dst, '\'');
+	for (; s < end; s++)
+	{
+		if (*s == '\'' || *s == '\\')
+			appendStringInfoChar(dst, *s);
+		appendStringInfoChar(dst, *s);
+	}
+	appendStringInfoChar(dst, '\'');
+}
+
+/*
+ * tsquery_empty - 빈 검색어, tsqueryin 은 NOTICE 를 내므로 직접 만듦
+ */
+static TSQuery
+tsquery_empty(void)
+{
+	TSQuery		query;
+
+	query = (TSQuery) palloc0(HDRSIZETQ);
+	SET_VARSIZE(query, HDRSIZETQ);
+	query->size = 0;
+
+	return query;
+}
+
+/*
+ * mecabko_cache_stats - 분석 결과 캐시 상태
+ */
+Datum
+mecabko_cache_stats(PG_FUNCTION_ARGS)
+{
+	TupleDesc	tupdesc;
+	Datum		values[4];
+	bool		nulls[4] = { 0 };
+
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	values[0] = Int64GetDatum(analysis_cache_hits);
+	values[1] = Int64GetDatum(analysis_cache_misses);
+	values[2] = Int32GetDatum(analysis_cache ? hash_get_num_entries(analysis_cache) : 0);
+	values[3] = Int64GetDatum((int64) analysis_cache_used);
+
+	PG_RETURN_DATUM(HeapTupleGetDatum(heap_form_tuple(tupdesc, values, nulls)));
+}
+
+/*
+ * textsearch_ko_reload_dictionary - mecab 사전을 다시 읽음
+ * 이 백엔드에서 먼저 새 모델을 만들어 보고 (못 읽으면 ERROR), 공유 사전 세대를
+ * 올려서 다른 백엔드들도 다음 분석 때 새로 읽게 함. 새 세대를 돌려줌.
+ * shared_preload_libraries 로 올리지 않았으면 이 백엔드만 다시 읽음
+ */
+Datum
+textsearch_ko_reload_dictionary(PG_FUNCTION_ARGS)
+{
+	mecab_model_t *model = mecab_model_create();
+	uint64		generation;
+
+	mecab_assert(model, mecab_strerror(NULL));
+
+	if (dict_shared != NULL)
+		generation = pg_atomic_add_fetch_u64(&dict_shared->generation, 1);
+	else
+		generation = model_generation + 1;
+
+	mecab_model_install(model, generation);
+
+	PG_RETURN_INT64((int64) generation);
+}
+
+/*
+ * stats_check_shared - 모든 백엔드 합계를 쓰려면 미리 올려둬야 함
+ */
+static void
+stats_check_shared(void)
+{
+	if (stats_shared == NULL)
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				 errmsg("textsearch_ko must be loaded via shared_preload_libraries to report all backends")));
+}
+
+/*
+ * textsearch_ko_stats - 분석 통계
+ * 인자가 참이면 모든 백엔드 합계 (이 백엔드 것도 먼저 더함)
+ * 시간들은 밀리초
+ */
+Datum
+textsearch_ko_stats(PG_FUNCTION_ARGS)
+{
+	bool		all_backends = PG_GETARG_BOOL(0);
+	TupleDesc	tupdesc;
+	Datum		values[NUM_STATS + 1];
+	bool		nulls[NUM_STATS + 1] = { 0 };
+	int64		counters[NUM_STATS];
+	TimestampTz	reset_time;
+	int			i;
+
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	if (all_backends)
+	{
+		stats_check_shared();
+		stats_flush();
+		for (i = 0; i < NUM_STATS; i++)
+			counters[i] = (int64) pg_atomic_read_u64(&stats_shared->counters[i]);
+		reset_time = (TimestampTz) pg_atomic_read_u64(&stats_shared->reset_time);
+	}
+	else
+	{
+		memcpy(counters, stats_local, sizeof(counters));
+		reset_time = stats_local_reset;
+	}
+
+	for (i = 0; i < NUM_STATS; i++)
+	{
+		if (i >= STATS_NORMALIZE_TIME)
+			values[i] = Float8GetDatum((double) counters[i] / 1000.0);
+		else
+			values[i] = Int64GetDatum(counters[i]);
+	}
+
+	/* 이 백엔드 통계를 지운 적이 없으면 NULL */
+	if (reset_time != 0)
+		values[NUM_STATS] = TimestampTzGetDatum(reset_time);
+	else
+		nulls[NUM_STATS] = true;
+
+	PG_RETURN_DATUM(HeapTupleGetDatum(heap_form_tuple(tupdesc, values, nulls)));
+}
+
+/*
+ * textsearch_ko_stats_reset - 이 백엔드 통계 지우기
+ * 인자가 참이면 모든 백엔드 합계도 지움
+ */
+Datum
+textsearch_ko_stats_reset(PG_FUNCTION_ARGS)
+{
+	bool		all_backends = PG_GETARG_BOOL(0);
+	int			i;
+
+	if (all_backends)
+		stats_check_shared();
+
+	/* 지우기 전 것은 합계에 남김 */
+	stats_flush();
+	memset(stats_local, 0, sizeof(stats_local));
+	memset(stats_flushed, 0, sizeof(stats_flushed));
+	stats_local_reset = GetCurrentTimestamp();
+
+	if (all_backends)
+	{
+		for (i = 0; i < NUM_STATS; i++)
+			pg_atomic_write_u64(&stats_shared->counters[i], 0);
+		pg_atomic_write_u64(&stats_shared->reset_time,
+							(uint64) stats_local_reset);
+	}
+
+	PG_RETURN_VOID();
+}
+
+
+/*
+ * morph_parse - feature CSV 를 한번 훑어서 fields, pieces 를 채움
+ * 쓴 활용 정보 조각 갯수를 반환
+ */
+static int
+morph_parse(mecab_morph *m, mecab_piece *pieces)
+{
+	const char *csv = m->feature;
+	const char *p = csv;
+	const char *detail;
+	const char *end;
+	const char *next;
+	int			i;
+
+	memset(m->fields, 0, sizeof(m->fields));
+	m->nfields = 0;
+	m->conjtype = CONJ_NONE;
+	m->npieces = 0;
+	m->pieces = pieces;
+
+	for (i = 0; i < NUM_CSV; i++)
+	{
+		int			len;
+
+		next = p;
+		while (*next != ',' && *next != '\0')
+			next++;
+		len = next - p;
+
+		if (i == 0)
+			m->pos = pos_lookup(p, len);
+
+		m->fields[i].offset = p - csv;
+		m->fields[i].length = (len == 1 && *p == '*') ? 0 : len;
+		m->nfields++;
+
+		if (*next == '\0')
+			break;
+		p = next + 1;
+	}
+
+	if (m->fields[MECAB_CONJTYPE].length > 0)
+	{
+		const char *t = morph_field_ptr(m, MECAB_CONJTYPE);
+		int			tlen = m->fields[MECAB_CONJTYPE].length;
+
+		if (tlen == 7 && strncmp(t, "Inflect", 7) == 0)
+			m->conjtype = CONJ_INFLECT;
+		else if (tlen == 8 && strncmp(t, "Compound", 8) == 0)
+			m->conjtype = CONJ_COMPOUND;
+		else if (tlen == 11 && strncmp(t, "Preanalysis", 11) == 0)
+			m->conjtype = CONJ_PREANALYSIS;
+	}
+
+	if (m->conjtype == CONJ_NONE || m->fields[MECAB_DETAIL].length == 0)
+		return 0;
+
+	/* "가깝/VA/...+어/EC/..." 를 + 로 나눔, "무궁+화" 처럼 태그가 없을 수도 있음 */
+	detail = morph_field_ptr(m, MECAB_DETAIL);
+	end = detail + m->fields[MECAB_DETAIL].length;
+	for (p = detail; p < end; p = next + 1)
+	{
+		mecab_piece *piece;
+		const char *slash;
+
+		next = p;
+		while (next < end && *next != '+')
+			next++;
+		for (slash = p; slash < next && *slash != '/'; slash++)
+			;
+		if (slash == p)
+			continue;			/* 빈 조각 */
+
+		piece = &pieces[m->npieces++];
+		piece->offset = p - csv;
+		piece->length = slash - p;
+		if (slash < next)
+		{
+			const char *tag = slash + 1;
+			const char *tagend = tag;
+
+			while (tagend < next && *tagend != '/')
+				tagend++;
+			piece->tag_offset = tag - csv;
+			piece->tag_length = tagend - tag;
+			piece->pos = pos_lookup(tag, tagend - tag);
+		}
+		else
+		{
+			piece->tag_offset = slash - csv;
+			piece->tag_length = 0;
+			piece->pos = m->pos;
+		}
+	}
+
+	return m->npieces;
+}
+
+/*
+ * morph_field - CSV위치에 * 나, 빈값이 아니면, 그 위치와 길이 반환
+ */
+static bool
+morph_field(const mecab_morph *m, int n, const char **t, int *tlen)
+{
+	if (n >= m->nfields || m->fields[n].length == 0)
+		return false;
+
+	*t = morph_field_ptr(m, n);
+	*tlen = m->fields[n].length;
+	return true;
+}
+
+/*
+ * 원문자 U+2460 ~ U+24FF 를 바꿀 아스키 문자열, normalize_init() 에서 채움
+ * len 이 0 이면 바꾸지 않음
+ */
+#define ENCLOSED_FIRST	0x2460
+#define ENCLOSED_LAST	0x24ff
+
+typedef struct
+{
+	uint8		len;
+	char		str[2];
+} enclosed_char;
+
+static enclosed_char enclosed_map[ENCLOSED_LAST - ENCLOSED_FIRST + 1];
+
+/*
+ * normalize_init - 원문자 변환표 만들기
+ */
+static void
+normalize_init(void)
+{
+	int			ch;
+
+	for (ch = ENCLOSED_FIRST; ch <= ENCLOSED_LAST; ch++)
+	{
+		enclosed_char *e = &enclosed_map[ch - ENCLOSED_FIRST];
+		int			n;
+
+		/* 원문자 숫자들 1~20 */
+		if (ch <= 0x249b)
+			n = (ch - 0x2460) % 20 + 1;
+		/* 알파벳 번호, 뒤에 공백 */
+		else if (ch <= 0x24e9)
+		{
+			e->len = 2;
+			e->str[0] = (char) ((ch - 0x249c) % 26 + 'a');
+			e->str[1] = ' ';
+			continue;
+		}
+		else if (ch == 0x24ea || ch == 0x24ff)
+			n = 0;
+		/* 11 ~ 20 */
+		else if (ch <= 0x24f4)
+			n = ch - 0x24eb + 11;
+		/* 겹원문자 1 ~ 10, 1.0 은 11 ~ 20 으로 잘못 바꿨음 */
+		else
+			n = ch - 0x24f5 + 1;
+
+		if (n < 10)
+		{
+			e->len = 1;
+			e->str[0] = (char) ('0' + n);
+		}
+		else
+		{
+			e->len = 2;
+			e->str[0] = (char) ('0' + n / 10);
+			e->str[1] = (char) ('0' + n % 10);
+		}
+	}
+}
+
+/*
+ * normalize_char - 3byte 문자 가운데, ascii 코드 문자로 바꿀 수 있는 것들은 바꿈
+ * 첫 바이트만으로 대부분 걸러내고, 바꿀 문자열 위치와 길이를 돌려줌
+ * Enclosed CJK Letters and Months 부분은 생략함
+ */
+static inline bool
+normalize_char(const unsigned char *s, const char **c, int *cnt)
+{
+	static const char ascii_chars[] =
+		" !\"#$%&'()*+,-./0123456789:;<=>?@ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+		"[\\]^_`abcdefghijklmnopqrstuvwxyz{|}~";
+	pg_wchar	ch;
+
+	switch (s[0])
+	{
+		case 0xe2:
+			/* 원문자 U+2460 ~ U+24FF */
+			if (s[1] < 0x91 || s[1] > 0x93)
+				return false;
+			ch = utf8_to_unicode(s);
+			if (ch < ENCLOSED_FIRST || enclosed_map[ch - ENCLOSED_FIRST].len == 0)
+				return false;
+			*c = enclosed_map[ch - ENCLOSED_FIRST].str;
+			*cnt = enclosed_map[ch - ENCLOSED_FIRST].len;
+			return true;
+		case 0xe3:
+			/* 공백 U+3000 */
+			if (s[1] != 0x80 || s[2] != 0x80)
+				return false;
+			*c = ascii_chars;
+			*cnt = 1;
+			return true;
+		case 0xef:
+			/* 전각 아스키 U+FF01 ~ U+FF5E */
+			if (s[1] != 0xbc && s[1] != 0xbd)
+				return false;
+			ch = utf8_to_unicode(s);
+			if (ch < 0xff01 || ch > 0xff5e)
+				return false;
+			*c = ascii_chars + (ch - 0xff00);
+			*cnt = 1;
+			return true;
+		default:
+			return false;
+	}
+}
+
+/*
+ * ascii_run_end - s 부터 이어지는 아스키 문자열의 끝 위치
+ * 한번에 32 (AVX2), 16 (SSE2), 8 바이트씩 건너뜀
+ */
+static inline const char *
+ascii_run_end(const char *s, const char *end)
+{
+#ifdef __AVX2__
+	while (end - s >= (int) sizeof(__m256i))
+	{
+		uint32		mask;
+
+		mask = _mm256_movemask_epi8(_mm256_loadu_si256((const __m256i *) s));
+		if (mask != 0)
+			return s + pg_rightmost_one_pos32(mask);
+		s += sizeof(__m256i);
+	}
+#endif
+#ifdef __SSE2__
+	while (end - s >= (int) sizeof(__m128i))
+	{
+		uint32		mask;
+
+		mask = _mm_movemask_epi8(_mm_loadu_si128((const __m128i *) s));
+		if (mask != 0)
+			return s + pg_rightmost_one_pos32(mask);
+		s += sizeof(__m128i);
+	}
+#else
+	while (end - s >= (int) sizeof(uint64))
+	{
+		uint64		chunk;
+
+		memcpy(&chunk, s, sizeof(uint64));
+		if (chunk & UINT64CONST(0x8080808080808080))
+			break;
+		s += sizeof(uint64);
+	}
+#endif
+	while (s < end && !IS_HIGHBIT_SET(*s))
+		s++;
+	return s;
+}
 
-			MemoryContext	ctx;
+/*
+ * hanja_reading - 한자 하나의 한글 독음, 없으면 0
+ * prev 는 앞 글자 (한글 음절이나 바꾼 한자), 0 이면 낱말 첫 글자
+ *  - 낱말 첫 글자면 두음법칙 (력 -> 역, 로 -> 노, 녀 -> 여)
+ *  - 모음이나 ㄴ 받침 뒤의 렬, 률은 열, 율 (비율, 나열)
+ */
+static pg_wchar
+hanja_reading(pg_wchar ch, pg_wchar prev)
+{
+	pg_wchar	r;
+	int			cho;
+	int			jung;
+	int			jong;
 
-			/* 시작과 끝 무시 */
-			switch (node->stat)
-			{
-			case MECAB_BOS_NODE:
-			case MECAB_EOS_NODE:
-				continue;
-			}
+	if (ch >= HANJA_URO_FIRST && ch <= HANJA_URO_LAST)
+		r = hanja_uro[ch - HANJA_URO_FIRST];
+	else if (ch >= HANJA_COMPAT_FIRST && ch <= HANJA_COMPAT_LAST)
+		r = hanja_compat[ch - HANJA_COMPAT_FIRST];
+	else
+		return 0;
 
-			/* 단어 처리
-                         * conjtype 값이 Inflect 이면, 
-                         * detail 기준으로 row로 분리 */
-
-			csv = node->feature;
-			if ((feature(node, MECAB_CONJTYPE, &conjtype, &conjlen))
-			    && (strncmp(conjtype, "Inflect,", 8) == 0)
-			    && (feature(node, MECAB_DETAIL, &conjtype, &conjlen))){
-				/* 용언 상세 정보로 처리, 없으면 그대로 */
-				do {
-					pluspos = strchr(conjtype, '+');
-					slashpos = strchr(conjtype , '/');
-					values[0] = make_text(conjtype, slashpos - conjtype);
-					for (i = 1; i <= NUM_CSV; i++)
-					{
-						if(i == 1){
-							values[i] = make_text(slashpos + 1,
-							strchr(slashpos + 1, '/') - slashpos - 1);
-						}
-						else if(i==3){
-							values[i] = make_text("F",1);
-						}
-						else if(i==4){
-							values[i] = make_text(conjtype, slashpos - conjtype);
-						}
-						else {
-							nulls[i] = true;
-						}
-					}
-					ctx = MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
-					tuple = heap_form_tuple(tupdesc, values, nulls);
-					tuples = lappend(tuples, tuple);
-					MemoryContextSwitchTo(ctx);
-					conjtype = pluspos + 1;
-				} while(pluspos != NULL);
-			}
-			else {
-				values[0] = make_text(node->surface, node->length);
+	if (r == 0)
+		return r;
 
+	cho = (r - HANGUL_BASE) / HANGUL_CHO_UNIT;
+	jung = (r - HANGUL_BASE) / HANGUL_JONG_COUNT % HANGUL_JUNG_COUNT;
+	if (prev != 0)
+	{
+		/* 렬, 률 */
+		if (cho == CHO_RIEUL && (jung == 6 || jung == 17) &&
+			(r - HANGUL_BASE) % HANGUL_JONG_COUNT == 8 &&
+			prev >= HANGUL_BASE && prev <= HANGUL_LAST)
+		{
+			jong = (prev - HANGUL_BASE) % HANGUL_JONG_COUNT;
+			if (jong == 0 || jong == JONG_NIEUN)
+				r += (CHO_IEUNG - CHO_RIEUL) * HANGUL_CHO_UNIT;
+		}
+	}
+	else if (cho == CHO_RIEUL || cho == CHO_NIEUN)
+	{
+		if (DUEUM_JUNG_MASK & (1 << jung))
+			r += (CHO_IEUNG - cho) * HANGUL_CHO_UNIT;
+		else if (cho == CHO_RIEUL)
+			r += (CHO_NIEUN - CHO_RIEUL) * HANGUL_CHO_UNIT;
+	}
+	return r;
+}
 
-				for (i = 1; i <= NUM_CSV; i++)
-				{
-					const char *n = strchr(csv, ',');
-					size_t		len = (n == NULL ? strlen(csv) : n - csv);
+/*
+ * hanja_next_choseong - s 다음 글자 (한글 음절이나 표에 있는 한자) 의 초성, 없으면 -1
+ */
+static int
+hanja_next_choseong(const unsigned char *s, const unsigned char *end, pg_wchar prev)
+{
+	pg_wchar	ch;
 
-					if (len == 0 || (len == 1 && csv[0] == '*'))
-					{
-						if (i == MECAB_BASIC + 1)
-							values[i] = make_text(node->surface, node->length);
-						else
-							nulls[i] = true;
-					}
-					else{
-						values[i] = make_text(csv, len);
-					}
+	if (end - s < 3 || uchar_mblen((const char *) s) != 3)
+		return -1;
+	ch = utf8_to_unicode(s);
+	if (IS_HANJA_LEAD(s))
+		ch = hanja_reading(ch, prev);
+	if (ch < HANGUL_BASE || ch > HANGUL_LAST)
+		return -1;
+	return (ch - HANGUL_BASE) / HANGUL_CHO_UNIT;
+}
 
-					if (n == NULL)
-					{
-						for (++i; i <= MECAB_BASIC; i++)
-							nulls[i] = true;
-						/* 未知語 */
-						for (; i <= NUM_CSV; i++)
-							values[i] = make_text(node->surface, node->length);
-						break;
-					}
+/*
+ * hanja_char - 3byte 문자가 표에 있는 한자면 독음을 c 에 utf-8 로 쓰고 돌려줌
+ * 不 은 다음 글자를 보고 ㄷ, ㅈ 앞이면 부 (부동산, 부정), 아니면 불 (불법, 불가)
+ * 다음 글자는 end 까지만 봄
+ */
+static inline pg_wchar
+hanja_char(const unsigned char *s, const unsigned char *end, pg_wchar prev,
+		   unsigned char *c)
+{
+	pg_wchar	ch;
+	pg_wchar	r;
 
-					csv = n + 1;
-				}
-				ctx = MemoryContextSwitchTo(funcctx->multi_call_memory_ctx);
-				tuple = heap_form_tuple(tupdesc, values, nulls);
-				tuples = lappend(tuples, tuple);
-				MemoryContextSwitchTo(ctx);
-			}
+	if (!IS_HANJA_LEAD(s))
+		return 0;
+	ch = utf8_to_unicode(s);
+	r = hanja_reading(ch, prev);
+	if (r == 0)
+		return r;
+	if (ch == HANJA_BUL || ch == HANJA_COMPAT_BUL)
+	{
+		int			cho = hanja_next_choseong(s + 3, end, r);
+
+		if (cho == CHO_DIGEUT || cho == CHO_JIEUT)
+			r = HANGUL_BU;
+	}
+	unicode_to_utf8(r, c);
+	return r;
+}
+
+/*
+ * hanja_convert - 한자만 한글로 바꾸고 나머지는 그대로 복사
+ * prev_hangul 은 앞 한글 글자 (없으면 0), 독음 고르는데 쓰고 바꿔서 돌려줌
+ */
+static void
+hanja_convert(StringInfo dst, const char *src, int srclen, pg_wchar *prev_hangul)
+{
+	const char *s = src;
+	const char *end = src + srclen;
+	unsigned char c[4];
+
+	enlargeStringInfo(dst, srclen);
+
+	while (s < end)
+	{
+		int			len;
+		pg_wchar	r;
+
+		if (!IS_HIGHBIT_SET(*s))
+		{
+			const char *q = ascii_run_end(s, end);
+
+			appendBinaryStringInfo(dst, s, q - s);
+			*prev_hangul = 0;
+			s = q;
+			continue;
+		}
 
+		len = Min(uchar_mblen(s), end - s);
+		if (len == 3 &&
+			(r = hanja_char((const unsigned char *) s,
+							(const unsigned char *) end,
+							*prev_hangul, c)) != 0)
+		{
+			appendBinaryStringInfo(dst, (const char *) c, 3);
+			*prev_hangul = r;
+		}
+		else
+		{
+			appendBinaryStringInfo(dst, s, len);
+			*prev_hangul = (len == 3 && IS_HANGUL_LEAD((const unsigned char *) s)) ?
+				utf8_to_unicode((const unsigned char *) s) : 0;
 		}
+		s += len;
+	}
+}
 
-		funcctx->max_calls = list_length(tuples);
-		funcctx->user_fctx = tuples;
+/* 초성 번호 -> 호환 자모 */
+static const uint16 jamo_cho[] = {
+	0x3131, 0x3132, 0x3134, 0x3137, 0x3138, 0x3139, 0x3141, 0x3142,
+	0x3143, 0x3145, 0x3146, 0x3147, 0x3148, 0x3149, 0x314A, 0x314B,
+	0x314C, 0x314D, 0x314E
+};
+
+/* 종성 번호 -> 호환 자모, 0 은 받침 없음 */
+static const uint16 jamo_jong[HANGUL_JONG_COUNT] = {
+	0, 0x3131, 0x3132, 0x3133, 0x3134, 0x3135, 0x3136, 0x3137,
+	0x3139, 0x313A, 0x313B, 0x313C, 0x313D, 0x313E, 0x313F, 0x3140,
+	0x3141, 0x3142, 0x3144, 0x3145, 0x3146, 0x3147, 0x3148, 0x314A,
+	0x314B, 0x314C, 0x314D, 0x314E
+};
+
+/* 호환 자모 -> 두 글쇠로 치는 겹자모 (ㄳ -> ㄱㅅ, ㅘ -> ㅗㅏ), 홑자모는 0 */
+static const uint16 jamo_split[JAMO_LAST - JAMO_FIRST + 1][2] = {
+	{0, 0}, {0, 0}, {0x3131, 0x3145}, {0, 0},					/* ㄱ ㄲ ㄳ ㄴ */
+	{0x3134, 0x3148}, {0x3134, 0x314E}, {0, 0}, {0, 0},			/* ㄵ ㄶ ㄷ ㄸ */
+	{0, 0}, {0x3139, 0x3131}, {0x3139, 0x3141}, {0x3139, 0x3142},	/* ㄹ ㄺ ㄻ ㄼ */
+	{0x3139, 0x3145}, {0x3139, 0x314C}, {0x3139, 0x314D}, {0x3139, 0x314E},	/* ㄽ ㄾ ㄿ ㅀ */
+	{0, 0}, {0, 0}, {0, 0}, {0x3142, 0x3145},					/* ㅁ ㅂ ㅃ ㅄ */
+	{0, 0}, {0, 0}, {0, 0}, {0, 0},								/* ㅅ ㅆ ㅇ ㅈ */
+	{0, 0}, {0, 0}, {0, 0}, {0, 0},								/* ㅉ ㅊ ㅋ ㅌ */
+	{0, 0}, {0, 0},												/* ㅍ ㅎ */
+	{0, 0}, {0, 0}, {0, 0}, {0, 0},								/* ㅏ ㅐ ㅑ ㅒ */
+	{0, 0}, {0, 0}, {0, 0}, {0, 0},								/* ㅓ ㅔ ㅕ ㅖ */
+	{0, 0}, {0x3157, 0x314F}, {0x3157, 0x3150}, {0x3157, 0x3163},	/* ㅗ ㅘ ㅙ ㅚ */
+	{0, 0}, {0, 0}, {0x315C, 0x3153}, {0x315C, 0x3154},			/* ㅛ ㅜ ㅝ ㅞ */
+	{0x315C, 0x3163}, {0, 0}, {0, 0}, {0x3161, 0x3163},			/* ㅟ ㅠ ㅡ ㅢ */
+	{0, 0}														/* ㅣ */
+};
+
+/*
+ * jamo_append - 호환 자모 하나를 utf-8 로 붙임, split 이면 겹자모를 나눠서
+ */
+static inline void
+jamo_append(StringInfo dst, pg_wchar ch, bool split)
+{
+	unsigned char c[4];
 
-		PG_FREE_IF_COPY(txt, 0);
+	if (split && ch >= JAMO_FIRST && ch <= JAMO_LAST &&
+		jamo_split[ch - JAMO_FIRST][0] != 0)
+	{
+		jamo_append(dst, jamo_split[ch - JAMO_FIRST][0], false);
+		jamo_append(dst, jamo_split[ch - JAMO_FIRST][1], false);
+		return;
 	}
-	else
+	unicode_to_utf8(ch, c);
+	appendBinaryStringInfo(dst, (const char *) c, 3);
+}
+
+/*
+ * jamo_choseong - 한글 음절은 초성으로 바꾸고 나머지 글자는 그대로 붙임
+ * (무궁화 -> ㅁㄱㅎ), 한글 음절이 있었는지 반환
+ */
+static bool
+jamo_choseong(StringInfo dst, const char *s, int len)
+{
+	const char *end = s + len;
+	bool		found = false;
+
+	while (s < end)
 	{
-		funcctx = SRF_PERCALL_SETUP();
-		tuples = funcctx->user_fctx;
+		int			clen = Min(uchar_mblen(s), end - s);
+		pg_wchar	ch = (clen == 3) ? utf8_to_unicode((const unsigned char *) s) : 0;
+
+		if (ch >= HANGUL_BASE && ch <= HANGUL_LAST)
+		{
+			jamo_append(dst, jamo_cho[(ch - HANGUL_BASE) / HANGUL_CHO_UNIT], false);
+			found = true;
+		}
+		else
+			appendBinaryStringInfo(dst, s, clen);
+		s += clen;
 	}
 
-	if (tuples == NIL)
-		SRF_RETURN_DONE(funcctx);
+	return found;
+}
+
+/*
+ * jamo_keys - 한글 음절과 자모를 글쇠 순서의 호환 자모로 풀어 붙임
+ * (무궁화 -> ㅁㅜㄱㅜㅇㅎㅗㅏ), 나머지 글자는 그대로, 한글이 있었는지 반환
+ * 쓰다 만 글자 (무구, 묵) 의 자모가 다 쓴 낱말 자모의 앞부분이 되도록
+ * 겹모음, 겹받침도 나눔
+ */
+static bool
+jamo_keys(StringInfo dst, const char *s, int len)
+{
+	const char *end = s + len;
+	bool		found = false;
+
+	while (s < end)
+	{
+		int			clen = Min(uchar_mblen(s), end - s);
+		pg_wchar	ch = (clen == 3) ? utf8_to_unicode((const unsigned char *) s) : 0;
+
+		if (ch >= HANGUL_BASE && ch <= HANGUL_LAST)
+		{
+			int			jong = (ch - HANGUL_BASE) % HANGUL_JONG_COUNT;
 
-	tuple = linitial(tuples);
-	funcctx->user_fctx = tuples = list_delete_first(tuples);
-	result = heap_copytuple(tuple);
-	pfree(tuple);
+			jamo_append(dst, jamo_cho[(ch - HANGUL_BASE) / HANGUL_CHO_UNIT], true);
+			jamo_append(dst, JAMO_VOWEL_FIRST +
+						(ch - HANGUL_BASE) / HANGUL_JONG_COUNT % HANGUL_JUNG_COUNT,
+						true);
+			if (jong != 0)
+				jamo_append(dst, jamo_jong[jong], true);
+			found = true;
+		}
+		else if (ch >= JAMO_FIRST && ch <= JAMO_LAST)
+		{
+			jamo_append(dst, ch, true);
+			found = true;
+		}
+		else
+			appendBinaryStringInfo(dst, s, clen);
+		s += clen;
+	}
 
-	SRF_RETURN_NEXT(funcctx, HeapTupleGetDatum(result));
+	return found;
 }
 
 /*
- * korean_normalize - normalize 함수 랩퍼
- * 
+ * offset_map_init - 빈 위치 기록 (원문과 같음)
  */
-Datum
-korean_normalize(PG_FUNCTION_ARGS)
+static void
+offset_map_init(offset_map *map)
 {
-	Datum			r;
-	text		   *txt = PG_GETARG_TEXT_PP(0);
-	StringInfoData	str;
+	map->n = 0;
+	map->max = 16;
+	map->dst = (int *) palloc(sizeof(int) * map->max);
+	map->src = (int *) palloc(sizeof(int) * map->max);
+}
 
-	initStringInfo(&str);
-	normalize(&str, VARDATA_ANY(txt), VARSIZE_ANY_EXHDR(txt), (append_t) appendBinaryStringInfo);
-	PG_FREE_IF_COPY(txt, 0);
+/*
+ * offset_map_add - 결과 dst 위치부터는 원문 src 위치에 맞춰짐
+ */
+static void
+offset_map_add(offset_map *map, int dst, int src)
+{
+	if (map->n > 0 && map->dst[map->n - 1] == dst)
+	{
+		map->src[map->n - 1] = src;
+		return;
+	}
+	if (map->n >= map->max)
+	{
+		map->max *= 2;
+		map->dst = (int *) repalloc(map->dst, sizeof(int) * map->max);
+		map->src = (int *) repalloc(map->src, sizeof(int) * map->max);
+	}
+	map->dst[map->n] = dst;
+	map->src[map->n] = src;
+	map->n++;
+}
 
-	r = CStringGetTextDatum(str.data);
-	pfree(str.data);
+/*
+ * offset_map_lookup - 결과 위치의 원문 위치
+ * 넣은 공백은 다음 원문 글자 위치로
+ */
+static int
+offset_map_lookup(const offset_map *map, int dst)
+{
+	int			lo = 0;
+	int			hi = map->n - 1;
 
-	PG_RETURN_DATUM(r);
+	/* dst 보다 작거나 같은 마지막 기록 */
+	while (lo <= hi)
+	{
+		int			mid = lo + (hi - lo) / 2;
+
+		if (map->dst[mid] <= dst)
+			lo = mid + 1;
+		else
+			hi = mid - 1;
+	}
+	if (hi < 0)
+		return dst;
+	return map->src[hi] + (dst - map->dst[hi]);
 }
 
 /*
- * hanja2hangul - 한자를 한글로 변환
+ * normalize - 문자정리
+ * 영숫자 : 전각 -> 반각
+ * 한자 : textsearch_ko.hanja_to_hangul 이 켜져 있으면 한글 독음으로
+ * 영어, 숫자가 부분 포함 된 것을 공백으로 분리
+ *
+ * 3byte 이상 문자와 미만 문자가 공백 없이 이어지면 공백문자 넣음
+ * 처리 안하면 mecab 쪽에서 분석 못함
+ * 아스키 구간은 통째로 복사하고, 앞 문자 출력 길이만 기억해서 한 번에 훑음
+ * map 이 있으면 결과 위치를 원문 위치로 되돌릴 수 있게 적어 둠
  */
-Datum
-hanja2hangul(PG_FUNCTION_ARGS)
+#define NORMALIZE_CHECK_INTERVAL	(64 * 1024)
+
+static void
+normalize(StringInfo dst, const char *src, size_t srclen, offset_map *map)
 {
-	mecab_t		   *mecab = mecab_acquire();
-	text		   *txt = PG_GETARG_TEXT_PP(0);
-	StringInfoData	str;
-	const mecab_node_t *node;
+	const char *s = src;
+	const char *end = src + srclen;
+	int			prev_len = 0;		/* 앞 문자 출력 길이, 0 이면 처음 */
+	bool		prev_space = false;	/* 앞 문자가 공백 */
+	pg_wchar	prev_hangul = 0;	/* 앞 한글 문자, 한자 독음 고르기용 */
+	unsigned char hangul[4];
+	char	   *out;
+	int			startlen = dst->len;
+	const char *checked = src;		/* 마지막으로 인터럽트를 확인한 곳 */
+	instr_time	start;
 
-	node = mecab_sparse_tonode2(mecab,
-			VARDATA_ANY(txt), VARSIZE_ANY_EXHDR(txt));
-	mecab_assert(node);
+	TRACE_TEXTSEARCH_KO_NORMALIZE_START(srclen);
+	stats_timer_start(start);
 
-	initStringInfo(&str);
+	/*
+	 * 바뀐 문자마다 공백 하나씩 늘 수 있으므로 남은 입력의 1/8 을 더 잡아 두고,
+	 * 모자라면 그때 늘림. 더 잡는 몫은 MaxAllocSize 를 넘지 않게 줄임
+	 */
+#define NORMALIZE_RESERVE(n) \
+	do { \
+		if (dst->maxlen - (out - dst->data) <= (n)) \
+		{ \
+			dst->len = out - dst->data; \
+			enlargeStringInfo(dst, Max((Size) (n), \
+									   Min((Size) (n) + (end - s) / 8, \
+										   MaxAllocSize - dst->len - 1))); \
+			out = dst->data + dst->len; \
+		} \
+	} while (0)
 
-	for (; node != NULL; node = node->next)
+	out = dst->data + dst->len;
+	NORMALIZE_RESERVE(srclen + 1);
+
+	while (s < end)
 	{
-		const char	*sori;
-		int		sorilen;
+		const char *c;
+		int			len;
+		int			cnt;
+		pg_wchar	r;
+
+		/* 문자마다 확인하면 아스키 구간을 통째로 훑는 의미가 없음 */
+		if (s - checked >= NORMALIZE_CHECK_INTERVAL)
+		{
+			CHECK_FOR_INTERRUPTS();
+			checked = s;
+		}
 
-		switch (node->stat)
+		if (!IS_HIGHBIT_SET(*s))
 		{
-		case MECAB_BOS_NODE:
-		case MECAB_EOS_NODE:
+			const char *q = ascii_run_end(s, end);
+
+			NORMALIZE_RESERVE(q - s + 1);
+			if (prev_len > 2 && *s != ' ')
+			{
+				*out++ = ' ';
+				if (map)
+					offset_map_add(map, out - dst->data - startlen, s - src);
+			}
+			memcpy(out, s, q - s);
+			out += q - s;
+			prev_len = 1;
+			prev_space = (q[-1] == ' ');
+			prev_hangul = 0;
+			s = q;
 			continue;
 		}
 
-		if (feature(node, MECAB_BASIC, &sori, &sorilen))
-			appendBinaryStringInfo(&str, sori, sorilen);
+		len = Min(uchar_mblen(s), end - s);
+		if (len == 3 && normalize_char((const unsigned char *) s, &c, &cnt))
+			prev_hangul = 0;
+		else if (len == 3 && normalize_hanja &&
+				 (r = hanja_char((const unsigned char *) s,
+								 (const unsigned char *) end,
+								 prev_hangul, hangul)) != 0)
+		{
+			c = (const char *) hangul;
+			cnt = 3;
+			prev_hangul = r;
+		}
 		else
-			appendBinaryStringInfo(&str, node->surface, node->length);
-		if(node->next != NULL) appendBinaryStringInfo(&str, " ", 1);
+		{
+			c = s;
+			cnt = len;
+			prev_hangul = (normalize_hanja && len == 3 &&
+						   IS_HANGUL_LEAD((const unsigned char *) s)) ?
+				utf8_to_unicode((const unsigned char *) s) : 0;
+		}
+
+		NORMALIZE_RESERVE(cnt + 1);
+		if ((prev_len > 0 && prev_len < 3 && cnt > 2 && !prev_space)
+			|| (prev_len > 2 && cnt < 3))
+		{
+			*out++ = ' ';
+			if (map)
+				offset_map_add(map, out - dst->data - startlen, s - src);
+		}
+		memcpy(out, c, cnt);
+		out += cnt;
+		if (map && cnt != len)
+			offset_map_add(map, out - dst->data - startlen, s + len - src);
+		prev_len = cnt;
+		prev_space = false;
+		s += len;
 	}
 
-	PG_FREE_IF_COPY(txt, 0);
+#undef NORMALIZE_RESERVE
 
-	PG_RETURN_DATUM(CStringGetTextDatum(str.data));
-}
+	dst->len = out - dst->data;
+	dst->data[dst->len] = '\0';
 
+	stats_add(STATS_NORMALIZED_BYTES, dst->len - startlen);
+	stats_timer_stop(STATS_NORMALIZE_TIME, start);
+	TRACE_TEXTSEARCH_KO_NORMALIZE_DONE(srclen, dst->len - startlen);
+}
 
 /*
- * feature - CSV위치에 * 나, 빈값이 아니면, 그 위치와 길이 반환
+ * chunk_boundary - len 바이트 안에서 조각을 자를 위치
+ * 뒤쪽 절반에서 문장 끝 (줄바꿈, 또는 . ? ! 다음 공백) 뒤를 찾고,
+ * 없으면 마지막 공백 뒤, 그것도 없으면 글자 경계에서 자름
+ * 글자 경계에서 자를 때 마지막 글자가 不 이면 그 앞에서 자름,
+ * 독음을 다음 글자로 정하므로 (hanja_char) 다음 글자와 같은 조각에 둠
  */
-static bool
-feature(const mecab_node_t *node, int n, const char **t, int *tlen)
+static int
+chunk_boundary(const char *s, int len)
 {
-	const char *csv = node->feature;
+	int			space = 0;
 	int			i;
-	const char *next;
-	size_t		len;
 
-	for (i = 0; i < n; i++)
+	for (i = len - 1; i > len / 2; i--)
 	{
-		next = strchr(csv, ',');
-		if (next == NULL)
-			return false;
-		csv = next + 1;
+		if (s[i] == '\n' ||
+			(isspace((unsigned char) s[i]) && strchr(".?!", s[i - 1]) != NULL))
+			return i + 1;
+		if (space == 0 && isspace((unsigned char) s[i]))
+			space = i + 1;
 	}
+	if (space > 0)
+		return space;
 
-	next = strchr(csv, ',');
-	len = (next == NULL ? strlen(csv) : next - csv);
+	/* 마지막 글자가 잘렸으면 그 앞에서 */
+	for (i = len - 1; i > 0 && (s[i] & 0xc0) == 0x80; i--)
+		;
+	if (i > 0 && i + uchar_mblen(s + i) > len)
+		len = i;
 
-	if (len == 0 || (len == 1 && csv[0] == '*'))
-		return false;
+	if (len > 3 && IS_HANJA_LEAD((const unsigned char *) s + len - 3))
+	{
+		pg_wchar	ch = utf8_to_unicode((const unsigned char *) s + len - 3);
 
-	*t = csv;
-	*tlen = len;
-	return true;
+		if (ch == HANJA_BUL || ch == HANJA_COMPAT_BUL)
+			return len - 3;
+	}
+	return len;
+}
+
+/*
+ * chunk_reader_init - text 인자를 조각씩 읽을 준비
+ * 압축 안 된 toast 값이면 필요한 조각만 읽어 오고, 아니면 한번에 풀어둠.
+ * 압축된 값은 detoast_attr_slice 로 읽어도 조각마다 앞에서부터 다시 풀어야
+ * 해서 문서 크기의 제곱만큼 걸리므로 한번만 풂
+ */
+static void
+chunk_reader_init(chunk_reader *reader, Datum datum)
+{
+	struct varlena *attr = (struct varlena *) DatumGetPointer(datum);
+
+	reader->datum = NULL;
+	reader->chunk = analysis_chunk_size * 1024;
+	reader->data = NULL;
+	reader->slice = NULL;
+	reader->offset = 0;
+
+	if (VARATT_IS_EXTERNAL_ONDISK(attr))
+	{
+		struct varatt_external toast_pointer;
+
+		VARATT_EXTERNAL_GET_POINTER(toast_pointer, attr);
+		if (!VARATT_EXTERNAL_IS_COMPRESSED(toast_pointer))
+		{
+			reader->datum = attr;
+			reader->size = toast_raw_datum_size(datum) - VARHDRSZ;
+			return;
+		}
+	}
+
+	reader->text = DatumGetTextPP(datum);
+	reader->data = VARDATA_ANY(reader->text);
+	reader->size = VARSIZE_ANY_EXHDR(reader->text);
 }
 
-/* 3byte 문자 가운데, ascii 코드 문자로 바꿀 수 있는 것들은 바꿈 */
-static bool ismbascii(const unsigned char *s, unsigned char *c, int *cnt){
-	pg_wchar ch;
+/*
+ * chunk_reader_next - 다음 조각, 다 읽었으면 false
+ * 조각 크기는 reader->chunk (기본값 textsearch_ko.chunk_size), 0 이면 한 조각
+ */
+static bool
+chunk_reader_next(chunk_reader *reader, const char **s, int *len)
+{
+	int			want = reader->size - reader->offset;
 
-	ch = utf8_to_unicode(s);
-	/* 공백 */
-	if(ch == 0x3000){
-		*cnt = 1;
-		ch = 0x20;
-		unicode_to_utf8(ch, c);
-	}
-	/* 전각 아스키 */
-	else if(ch >= 0xFF01 && ch <= 0xff5e){
-		*cnt = 1;
-		ch = ch - (0xff01) + 0x21;
-		unicode_to_utf8(ch, c);
-	}
-	else if(ch == 0x24ea || ch == 0x24ff){
-		*cnt = 1;
-		sprintf((char *)c, "0");
-	}
-	/* 원문자 숫자들 1~20 */
-	else if(ch >= 0x2460 && ch <= 0x249b){
-		sprintf((char *)c, "%d", (ch - 0x2460 ) % 20 + 1);
-		*cnt = strlen((const char *)c);
-	}
-	/* 알파벳 번호 */
-	else if(ch >= 0x249c && ch <= 0x24e9) {
-		sprintf((char *)c, "%c ", (char)((ch - 0x249c) % 26 + 0x61));
-		*cnt = strlen((const char *)c);
-	}
-	/* 11 ~ 20 */
-	else if(ch >= 0x24eb && ch <= 0x24f4) {
-		sprintf((char *)c, "%d", ch - 0x24eb + 11 );
-		*cnt = strlen((const char *)c);
-	}
-	/* 1 ~ 10 */
-	else if(ch >= 0x24f5 && ch <= 0x24fe) {
-		sprintf((char *)c, "%d", ch - 0x24eb + 1 );
-		*cnt = strlen((const char *)c);
-	}
-	/* Enclosed CJK Letters and Months 부분은 생략함 */
-	else{
+	if (reader->slice != NULL)
+	{
+		pfree(reader->slice);
+		reader->slice = NULL;
+	}
+
+	if (want <= 0)
 		return false;
+	if (reader->chunk > 0 && want > reader->chunk)
+		want = reader->chunk;
+
+	if (reader->datum != NULL)
+	{
+		reader->slice = DatumGetTextPSlice(PointerGetDatum(reader->datum),
+										   reader->offset, want);
+		*s = VARDATA_ANY(reader->slice);
+		want = VARSIZE_ANY_EXHDR(reader->slice);
 	}
+	else
+		*s = reader->data + reader->offset;
+
+	if (reader->offset + want < reader->size)
+		want = chunk_boundary(*s, want);
+
+	*len = want;
+	reader->offset += want;
 	return true;
 }
 
 /*
- * normalize - 문자정리
- * 영숫자 : 전각 -> 반각
- * 영어, 숫자가 부분 포함 된 것을 공백으로 분리
- * TODO 
+ * chunk_reader_end - 뒷 정리, 인자를 풀어서 복사한 것도 버림
  */
 static void
-normalize(StringInfo dst, const char *src, size_t srclen, append_t append)
+chunk_reader_end(chunk_reader *reader, Datum datum)
 {
-	int len, nextcharlen, current_len;
-	const unsigned char *s = (const unsigned char *)src;
-        const unsigned char *end = s + srclen;
-	unsigned char *newch;
-	newch = (unsigned char *) palloc(4);
-	for (; s < end; s += len){
-		//ch = s[0];
-		len = uchar_mblen(s);
-		if(len == 3 && ismbascii(s, newch, &current_len)){
-			appendBinaryStringInfo(dst, (const char *)newch, current_len);
-		}
-		else {
-			appendBinaryStringInfo(dst, (const char *)s, len);
-			current_len = len;
-		}
-
-		/* 3byte 이상 문자와 미만 문자가 공백 없이 이어지면 공백문자 넣음 */
-		/* 처리 안하면 mecab 쪽에서 분석 못함 */
-		if((s + len) < end){
-			nextcharlen = uchar_mblen(s + len);
-			if(nextcharlen > 2) {
-				ismbascii(s + len, newch, &nextcharlen);
-			}
-			if((current_len < 3 && nextcharlen > 2 && (s)[0] != 0x20)
-				|| (current_len > 2 && nextcharlen < 3 && (s+len)[0] != 0x20))
-				appendBinaryStringInfo(dst, " ", 1);
-		}
-	}
-	pfree(newch);
+	if (reader->slice != NULL)
+		pfree(reader->slice);
+	if (reader->data != NULL &&
+		(Pointer) reader->text != DatumGetPointer(datum))
+		pfree(reader->text);
 }
 
 /*
@@ -747,62 +5570,98 @@ lexize(const char *str, size_t len)
 	return r;
 }
 
-static bool
-accept_mecab_ko_part(const char* str, int slen){
-	bool isfind = false;
-	int i=0;
-	char input_str[15];
-	strncpy(input_str, str, slen);
-	input_str[slen] = '\0';
-	while(1){
-		if(strcmp(accept_parts_of_speech[i], "") == 0) break;
-		if(strncmp(accept_parts_of_speech[i], input_str, slen +1) == 0){
-			isfind = true;
-			break;
-		}
-		i += 1;
-	}
-	return isfind;
+/*
+ * pos_hash - 품사 태그 해시값
+ */
+static inline uint32
+pos_hash(const char *str, int len)
+{
+	uint32		h = len;
+	int			i;
+
+	for (i = 0; i < len; i++)
+		h = h * 31 + (unsigned char) str[i];
+
+	return h & (POS_HASH_SIZE - 1);
 }
 
 /*
- * 줄바꿈 문자가 있을 경우, 영어와 한국어 처리를 다르게 함
+ * pos_hash_init - 품사 태그 해시 테이블 만듦
  */
 static void
-appendString(StringInfo dst, const unsigned char *src, int srclen)
+pos_hash_init(void)
 {
-        /* 1byte 출력할 수 없는 것은 \v로 */
-	if (srclen == 1 && !isprint(src[0]))
+	int			i;
+
+	StaticAssertStmt(lengthof(pos_tags) <= 64, "too many part of speech tags");
+
+	memset(pos_hash_table, 0, sizeof(pos_hash_table));
+	for (i = 0; i < lengthof(pos_tags); i++)
 	{
-		if (dst->len == 0 || *StringInfoTail(dst, 1) != SEPARATOR_CHAR)
-			appendStringInfoChar(dst, SEPARATOR_CHAR);
+		uint32		h = pos_hash(pos_tags[i], strlen(pos_tags[i]));
+
+		while (pos_hash_table[h] != 0)
+			h = (h + 1) & (POS_HASH_SIZE - 1);
+		pos_hash_table[h] = i + 1;
 	}
-	else if (dst->len > 1)
+}
+
+/*
+ * pos_lookup - 품사 태그로 품사 번호를 구함, 모르는 태그면 -1
+ */
+static int
+pos_lookup(const char *str, int len)
+{
+	uint32		h;
+
+	if (len <= 0 || len > POS_TAG_MAXLEN)
+		return -1;
+
+	for (h = pos_hash(str, len); pos_hash_table[h] != 0;
+		 h = (h + 1) & (POS_HASH_SIZE - 1))
 	{
-		if (*StringInfoTail(dst, 1) == SEPARATOR_CHAR)
-		{
-			bool ishigh = IS_HIGHBIT_SET(*StringInfoTail(dst, 2));
-			if (srclen == 1 && !ishigh)
-			{
-				/* "A[줄바꿈]A" ⇒ "A A" */
-				*StringInfoTail(dst, 1) = ' ';
-			}
-			else if (ishigh)
-			{
-				/* "아[줄바끔]아" ⇒ "아아" */
-				dst->len--;
-			}
-		}
-		else
-		{
-			bool ishigh = IS_HIGHBIT_SET(*StringInfoTail(dst, 1));
-			if ((srclen == 1 && ishigh) || (srclen > 1 && !ishigh))
-				appendStringInfoChar(dst, SEPARATOR_CHAR);
-		}
-		appendBinaryStringInfo(dst, (const char *) src, srclen);
+		const char *tag = pos_tags[pos_hash_table[h] - 1];
+
+		if (strncmp(tag, str, len) == 0 && tag[len] == '\0')
+			return pos_hash_table[h] - 1;
 	}
-	else
+
+	return -1;
+}
+
+/*
+ * pos_set_parse - 'NNG,NNP,VV' 같은 품사 목록을 품사 집합으로
+ */
+static pos_set
+pos_set_parse(const char *list)
+{
+	pos_set		result = 0;
+	const char *p = list;
+
+	while (*p)
 	{
-		appendBinaryStringInfo(dst, (const char *) src, srclen);
+		const char *start;
+		int			pos;
+
+		while (*p == ',' || isspace((unsigned char) *p))
+			p++;
+		if (*p == '\0')
+			break;
+
+		start = p;
+		while (*p && *p != ',' && !isspace((unsigned char) *p))
+			p++;
+
+		pos = pos_lookup(start, p - start);
+		if (pos < 0)
+			ereport(ERROR,
+					(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+					 errmsg("unrecognized part of speech: \"%.*s\"",
+							(int) (p - start), start)));
+		result |= POS_BIT(pos);
 	}
+
+	return result;
 }
+
+
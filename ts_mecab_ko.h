@@ -13,8 +13,6 @@
 
 #include "lib/stringinfo.h"
 
-typedef void (*append_t)(StringInfo dst, const unsigned char *src, int srclen);
-
 #define StringInfoTail(str, at) \
 	((unsigned char *) ((str)->data + (str)->len - (at)))
 
@@ -22,4 +20,49 @@ typedef void (*append_t)(StringInfo dst, const unsigned char *src, int srclen);
 #define uchar_strlen(ustr)				strlen((const char *) (ustr))
 #define appendMBString(dst, ustr, len)	appendBinaryStringInfo((dst), (const char *) (ustr), (len))
 
+/*
+ * USDT 정적 추적점 (provider textsearch_ko), perf, bpftrace 로 붙여 봄
+ * USE_SDT 로 빌드하지 않으면 아무것도 하지 않음. 길이는 바이트
+ *  parse_start (문서 길이, 분석 방식), parse_start_done (문서 길이, 첫 조각 토큰 수),
+ *  parse_done (문서 길이, 넘겨준 토큰 수), normalize_start (입력 길이),
+ *  normalize_done (입력 길이, 결과 길이), mecab_start (입력 길이),
+ *  mecab_done (입력 길이, 노드 수), token (토큰 형식, 길이),
+ *  lexize_start (낱말 길이), lexize_done (낱말 길이, 돌려준 단어 수)
+ */
+#ifdef USE_SDT
+#include <sys/sdt.h>
+
+#define TRACE_TEXTSEARCH_KO_PARSE_START(doclen, mode) \
+	DTRACE_PROBE2(textsearch_ko, parse_start, doclen, mode)
+#define TRACE_TEXTSEARCH_KO_PARSE_START_DONE(doclen, ntokens) \
+	DTRACE_PROBE2(textsearch_ko, parse_start_done, doclen, ntokens)
+#define TRACE_TEXTSEARCH_KO_PARSE_DONE(doclen, ntokens) \
+	DTRACE_PROBE2(textsearch_ko, parse_done, doclen, ntokens)
+#define TRACE_TEXTSEARCH_KO_NORMALIZE_START(srclen) \
+	DTRACE_PROBE1(textsearch_ko, normalize_start, srclen)
+#define TRACE_TEXTSEARCH_KO_NORMALIZE_DONE(srclen, dstlen) \
+	DTRACE_PROBE2(textsearch_ko, normalize_done, srclen, dstlen)
+#define TRACE_TEXTSEARCH_KO_MECAB_START(len) \
+	DTRACE_PROBE1(textsearch_ko, mecab_start, len)
+#define TRACE_TEXTSEARCH_KO_MECAB_DONE(len, nnodes) \
+	DTRACE_PROBE2(textsearch_ko, mecab_done, len, nnodes)
+#define TRACE_TEXTSEARCH_KO_TOKEN(type, len) \
+	DTRACE_PROBE2(textsearch_ko, token, type, len)
+#define TRACE_TEXTSEARCH_KO_LEXIZE_START(len) \
+	DTRACE_PROBE1(textsearch_ko, lexize_start, len)
+#define TRACE_TEXTSEARCH_KO_LEXIZE_DONE(len, nlexemes) \
+	DTRACE_PROBE2(textsearch_ko, lexize_done, len, nlexemes)
+#else
+#define TRACE_TEXTSEARCH_KO_PARSE_START(doclen, mode)			do {} while (0)
+#define TRACE_TEXTSEARCH_KO_PARSE_START_DONE(doclen, ntokens)	do {} while (0)
+#define TRACE_TEXTSEARCH_KO_PARSE_DONE(doclen, ntokens)		do {} while (0)
+#define TRACE_TEXTSEARCH_KO_NORMALIZE_START(srclen)			do {} while (0)
+#define TRACE_TEXTSEARCH_KO_NORMALIZE_DONE(srclen, dstlen)	do {} while (0)
+#define TRACE_TEXTSEARCH_KO_MECAB_START(len)				do {} while (0)
+#define TRACE_TEXTSEARCH_KO_MECAB_DONE(len, nnodes)			do {} while (0)
+#define TRACE_TEXTSEARCH_KO_TOKEN(type, len)				do {} while (0)
+#define TRACE_TEXTSEARCH_KO_LEXIZE_START(len)				do {} while (0)
+#define TRACE_TEXTSEARCH_KO_LEXIZE_DONE(len, nlexemes)		do {} while (0)
+#endif
+
 #endif /* TS_MECAB_KO_H */